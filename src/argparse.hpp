@@ -33,10 +33,95 @@
 
 /* Usage:
  * use #define ARGPARSE_IMPLEMENT - Implement the library
+ * use #define ARGPARSE_STRING_VIEW - Keep arguments as std::string_view into argv instead of copying them (C++17)
+ * use #define ARGPARSE_RESPONSE_FILES - Expand '@file' arguments with the contents of the file
+ * use #define ARGPARSE_FUZZ - Define LLVMFuzzerTestOneInput() fuzzing entry point (with ARGPARSE_IMPLEMENT)
+ * use #define ARGPARSE_BENCHMARK - Define main() that measures parsing, see Benchmark below (with ARGPARSE_IMPLEMENT)
+ * use #define ARGPARSE_TEST - Define main() that runs the tests, see Benchmark below (with ARGPARSE_IMPLEMENT)
  *
  * Example:
  * ArgParse argp( argc, argv );
  * bool a = argp.hasFlag( "-a" );
+ *
+ * Flags are hashed once by the constructor, hasFlag() doesn't allocate.
+ *
+ * Schema: (C++17)
+ * constexpr ArgOption options[] = {
+ *     { "verbose", 'v', ARG_FLAG, "Print more" },
+ *     { "jobs", 'j', ARG_INT, "Number of threads" },
+ *     { "mode", 'm', ARG_ENUM, "Build mode", "debug|release" }
+ * };
+ *
+ * constexpr ArgSchema schema( options );
+ * constexpr size_t JOBS = schema.index( "jobs" ); // typo fails to compile
+ *
+ * ArgResult result = argp.parse( schema ); // throws ArgException on invalid input
+ * long long jobs = result.getInt( JOBS, 1 );
+ *
+ * index() throws (so is a compile error in constexpr context) for unknown names, find() returns
+ * count instead. ArgResult getters throw ArgException for handles outside of the schema.
+ *
+ * Supports '--name=value', '--name value', '-n value', '-nvalue', bundled
+ * short flags '-abc' and '--' terminator. ARG_ENUM is stored as the choice index,
+ * ARG_FLAG as the number of times it was given.
+ *
+ * Subcommands: (C++17)
+ * constexpr ArgCommand commands[] = {
+ *     { "build", &build_schema, build_handler, "Build the project" },
+ *     { "run", &run_schema, run_handler, "Run the project" }
+ * };
+ *
+ * int code = ArgParse::dispatch( commands, argc, argv );
+ *
+ * First argument selects the command, only its schema is parsed (from the remaining
+ * arguments) and its handler is called with the result. Unknown or missing command throws
+ * ArgException. Command without schema gets all remaining arguments as positional.
+ *
+ * Completion: (C++17)
+ * std::string script = ArgParse::completion( "bash", "tool", schema );
+ * if( ArgParse::complete( argc, argv, schema ) ) return 0;
+ *
+ * completion() generates static bash, zsh or fish script (from ArgSchema or ArgCommands)
+ * that needs no calls into the program. complete() should be checked first thing in main(),
+ * before any initialization, for 'tool --complete [words...] current' it prints matching
+ * options, commands or choices (one per line) and returns true. A lone '-' lists both forms
+ * of every option, '-abc' and '-mvalue' are completed as short options. Names, commands and
+ * choices are quoted in the scripts, so they can contain spaces and quotes.
+ *
+ * Layered options: (C++17)
+ * ArgResult result = argp.resolve( schema, "TOOL", "/etc/tool.ini" );
+ *
+ * Each option is taken from the first layer that sets it: command line, environment
+ * variable 'TOOL_NAME' (uppercase, '-' and '.' become '_'), INI file ('name = value',
+ * '[section]' adds 'section.' prefix) and finally ArgOption::fallback. Missing file
+ * is skipped, unknown keys in it throw ArgException. Lists in environment are ',' separated.
+ * ARG_FLAG taken from environment, file or fallback is a boolean (1/true/yes/on, 0/false/no/off,
+ * bare 'name' in the file) or a count, false sets it with count 0. The result is read only, can be
+ * copied (file contents are shared) and is indexed by the same constexpr handles as parse().
+ *
+ * Response files: (ARGPARSE_RESPONSE_FILES)
+ * Each '@file' argument is replaced by the whitespace separated arguments from that file,
+ * '...' and "..." quotes and backslash escapes are supported and files can include other
+ * files (up to ARGPARSE_RESPONSE_DEPTH levels). Files are read (or memory mapped when larger
+ * than ARGPARSE_RESPONSE_MAP bytes) and tokenized in place, so arguments point straight into
+ * the buffer. getArguments() and getCount() return the expanded argv. Results of parse() and
+ * resolve() share the buffers, so their values stay valid after the ArgParse is gone (values
+ * taken directly from argv are valid as long as argv). Unreadable files are kept
+ * as normal arguments, '@' naming a directory or other non regular file and a file that
+ * (directly or not) includes itself throw ArgException. Truncating a mapped file while
+ * it is in use raises SIGBUS on access, like with any other mapping.
+ *
+ * Benchmark: (ARGPARSE_BENCHMARK, ARGPARSE_TEST)
+ * g++ -x c++ -O2 -std=c++20 -DARGPARSE_IMPLEMENT -DARGPARSE_BENCHMARK argparse.hpp -o bench
+ * g++ -x c++ -std=c++20 -DARGPARSE_IMPLEMENT -DARGPARSE_TEST -DARGPARSE_RESPONSE_FILES argparse.hpp -o test
+ *
+ * Both are vstl tests (vstl.hpp has to be next to this header) and can be combined into one
+ * binary, the exit code is the number of failed tests. The benchmark defines a counting global
+ * operator new, builds synthetic argv with 10, 100, ... up to ARGPARSE_BENCHMARK_LIMIT (1M)
+ * arguments and prints average construction time, hasFlag() time (half hits, half misses) and,
+ * with C++17, parse( schema ) time, each with the number of allocations per call. The tests
+ * cover flag lookup, schema parsing, numbers, layered options and response files, they create
+ * and remove small files in the working directory.
  */
 
 #ifndef ARGPARSE_HPP_
@@ -46,42 +131,340 @@
 #include <string>
 #include <algorithm>
 
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define ARGPARSE_CXX17
+#include <string_view>
+#include <charconv>
+#endif
+
+#ifdef ARGPARSE_RESPONSE_FILES
+#ifndef ARGPARSE_RESPONSE_DEPTH
+#define ARGPARSE_RESPONSE_DEPTH 16
+#endif
+#ifndef ARGPARSE_RESPONSE_MAP
+#define ARGPARSE_RESPONSE_MAP (1 << 20)
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <cstdio>
+#include <cstdlib>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
+#ifdef ARGPARSE_STRING_VIEW
+typedef std::string_view ArgString;
+#else
+typedef std::string ArgString;
+#endif
+
+class ArgException: public std::exception {
+
+	private:
+		std::string error;
+
+	public:
+		explicit ArgException( const std::string error );
+		virtual const char* what() const throw();
+};
+
+#ifdef ARGPARSE_CXX17
+
+enum ArgType : unsigned char {
+
+	/// option without value, can be repeated (-vvv)
+	ARG_FLAG,
+
+	/// integer value, parsed with std::from_chars
+	ARG_INT,
+
+	/// floating point value, parsed with std::from_chars
+	ARG_DOUBLE,
+
+	/// any string value
+	ARG_STRING,
+
+	/// one of the '|' separated choices, stored as the choice index
+	ARG_ENUM,
+
+	/// string value that can be given many times
+	ARG_LIST
+
+};
+
+struct ArgOption {
+
+	const char* name;
+	char alias;
+	ArgType type;
+	const char* help;
+	const char* choices = nullptr;
+	const char* fallback = nullptr;
+
+};
+
+struct ArgSchema {
+
+	const ArgOption* options;
+	size_t count;
+
+	template<size_t N>
+	constexpr ArgSchema( const ArgOption (&options)[N] )
+	: options( options ), count( N ) {}
+
+	/// returns option index or count if there is no such option
+	constexpr size_t find( std::string_view name ) const {
+		for( size_t i = 0; i < count; i ++ ) {
+			if( name == options[i].name ) return i;
+		}
+
+		return count;
+	}
+
+	/// returns option index or count if there is no such option
+	constexpr size_t find( char alias ) const {
+		for( size_t i = 0; i < count; i ++ ) {
+			if( alias != 0 && alias == options[i].alias ) return i;
+		}
+
+		return count;
+	}
+
+	/// returns option index, throws if there is no such option
+	constexpr size_t index( std::string_view name ) const {
+		size_t index = find( name );
+		if( index == count ) throw ArgException( "Unknown option name" );
+		return index;
+	}
+
+};
+
+struct ArgValue {
+
+	bool set = false;
+	long long integer = 0;
+	double real = 0;
+	std::string_view text;
+	std::vector<std::string_view> list;
+
+};
+
+class ArgResult {
+
+	public:
+		bool has( size_t option ) const;
+		long long getInt( size_t option, long long fallback = 0 ) const;
+		double getDouble( size_t option, double fallback = 0 ) const;
+		std::string_view getString( size_t option, std::string_view fallback = {} ) const;
+		const std::vector<std::string_view>& getList( size_t option ) const;
+		const std::vector<std::string_view>& getPositional() const;
+
+	private:
+		friend class ArgParse;
+
+		const ArgValue& value( size_t option ) const;
+
+		std::vector<ArgValue> values;
+		std::vector<std::string_view> positional;
+		std::shared_ptr<char[]> storage;
+		std::shared_ptr<const void> arguments;
+
+};
+
+typedef int (*ArgHandler) ( const ArgResult& result );
+
+struct ArgCommand {
+
+	const char* name;
+	const ArgSchema* schema;
+	ArgHandler handler;
+	const char* help = nullptr;
+
+};
+
+struct ArgCommands {
+
+	const ArgCommand* commands;
+	size_t count;
+
+	template<size_t N>
+	constexpr ArgCommands( const ArgCommand (&commands)[N] )
+	: commands( commands ), count( N ) {}
+
+	/// returns command index or count if there is no such command
+	constexpr size_t find( std::string_view name ) const {
+		for( size_t i = 0; i < count; i ++ ) {
+			if( name == commands[i].name ) return i;
+		}
+
+		return count;
+	}
+
+};
+
+#endif
+
 class ArgParse {
 
 	public:
 		ArgParse( int argc, char **argv );
 		ArgParse( ArgParse&& argp );
+		~ArgParse();
 
 		bool hasFlag( const char* name );
 		bool isEmpty();
-		const std::string& getName();
-		const std::vector<std::string>& getFlags();
-		const std::vector<std::string>& getValues();
+
+#ifdef ARGPARSE_CXX17
+		bool hasFlag( std::string_view name );
+		ArgResult parse( const ArgSchema& schema );
+		ArgResult resolve( const ArgSchema& schema, const char* prefix, const char* path );
+
+		static ArgResult parse( const ArgSchema& schema, char** args, int count );
+
+		int dispatch( const ArgCommands& commands );
+		static int dispatch( const ArgCommands& commands, int argc, char** argv );
+
+		static std::string completion( const char* shell, const char* program, const ArgSchema& schema );
+		static std::string completion( const char* shell, const char* program, const ArgCommands& commands );
+		static bool complete( int argc, char** argv, const ArgSchema& schema );
+		static bool complete( int argc, char** argv, const ArgCommands& commands );
+#endif
+
+		const ArgString& getName();
+		const std::vector<ArgString>& getFlags();
+		const std::vector<ArgString>& getValues();
+		char** getArguments();
+		int getCount();
 
 	private:
-		std::vector<std::string> flags;
-		std::vector<std::string> values;
-		std::string name;
+		std::vector<ArgString> flags;
+		std::vector<ArgString> values;
+		std::vector<unsigned> index;
+		ArgString name;
 		bool empty;
+		int argc;
+		char** argv;
+
+		void buildIndex();
+		bool lookup( const char* name, size_t length, size_t hash );
+
+#ifdef ARGPARSE_RESPONSE_FILES
+		struct Buffer {
+			char* data;
+			size_t size;
+			bool mapped;
+		};
+
+		// file contents, shared with every ArgResult parsed from them
+		struct Buffers {
+			std::vector<Buffer> list;
+			~Buffers();
+		};
+
+		std::vector<char*> expanded;
+		std::shared_ptr<Buffers> buffers;
+
+		// identities of the files that are being expanded right now
+		std::vector<std::string> active;
+
+		void expand( const char* path, int depth );
+		void tokenize( char* data, size_t size, int depth );
+#endif
+
+#ifdef ARGPARSE_CXX17
+		static void store( const ArgOption& option, ArgValue& value, std::string_view text );
+		static void storeFlag( const ArgOption& option, ArgValue& value, std::string_view text );
+		static void load( const ArgSchema& schema, ArgResult& result, const char* path );
+		static std::string completion( const char* shell, const char* program, const ArgSchema* schema, const ArgCommands* commands );
+		static void bashOptions( std::string& out, const ArgSchema& schema, const char* indent );
+		static void fishOptions( std::string& out, const char* program, const ArgSchema& schema, const std::string& condition );
+		static std::string quote( std::string_view text, bool fish );
+		static void candidates( const ArgSchema& schema, std::string_view previous, std::string_view current );
+#endif
 
 };
 
 #ifdef ARGPARSE_IMPLEMENT
 
+ArgException::ArgException( const std::string err ) {
+	this->error = err;
+}
+
+const char* ArgException::what() const throw() {
+	return this->error.c_str();
+}
+
 ArgParse::ArgParse( int argc, char **argv ) {
 
+#ifdef ARGPARSE_RESPONSE_FILES
+	bool response = false;
+	for( int i = 1; i < argc && !response; i ++ ) {
+		response = argv[i] && argv[i][0] == '@' && argv[i][1];
+	}
+
+	// replace '@file' arguments with the file contents, argv is then pointing into the mapped files
+	if( response ) {
+		this->buffers = std::make_shared<Buffers>();
+		this->expanded.reserve( argc );
+		this->expanded.push_back( argv[0] );
+
+		try {
+			for( int i = 1; i < argc; i ++ ) {
+				if( !argv[i] ) continue;
+
+				if( argv[i][0] == '@' && argv[i][1] ) {
+					this->expand( argv[i] + 1, 1 );
+				}else{
+					this->expanded.push_back( argv[i] );
+				}
+			}
+		} catch( ... ) {
+			this->buffers.reset();
+			throw;
+		}
+
+		argc = (int) this->expanded.size();
+		this->expanded.push_back( nullptr );
+		argv = this->expanded.data();
+	}
+#endif
+
+	this->argc = argc;
+	this->argv = argv;
+
 	if( argc > 0 ) {
 
-		this->name = std::string( argv[0] );
+		this->name = argv[0] ? ArgString( argv[0] ) : ArgString();
+
+		// count first so that both vectors are allocated only once
+		int count = 0;
+		for( int i = 1; i < argc; i ++ ) {
+			if( argv[i] && argv[i][0] == '-' ) count ++;
+		}
+
+		flags.reserve( count );
+		values.reserve( argc - 1 - count );
 
 		for( int i = 1; i < argc; i ++ ) {
 
-			std::string arg( argv[i] );
+			const char* arg = argv[i];
+			if( !arg ) continue;
 
 			if( arg[0] == '-' ) {
-				flags.push_back( arg );
+				flags.emplace_back( arg );
 			}else{
-				values.push_back( arg );
+				values.emplace_back( arg );
 			}
 
 		}
@@ -89,36 +472,1372 @@ ArgParse::ArgParse( int argc, char **argv ) {
 	}
 
 	this->empty = (argc <= 1);
+	this->buildIndex();
 
 }
 
 ArgParse::ArgParse( ArgParse&& argp ) {
 	this->flags = std::move( argp.flags );
 	this->values = std::move( argp.values );
+	this->index = std::move( argp.index );
 	this->name = std::move( argp.name );
 	this->empty = std::move( argp.empty );
+	this->argc = argp.argc;
+	this->argv = argp.argv;
+
+#ifdef ARGPARSE_RESPONSE_FILES
+	this->expanded = std::move( argp.expanded );
+	this->buffers = std::move( argp.buffers );
+#endif
+}
+
+ArgParse::~ArgParse() {
+
+}
+
+#ifdef ARGPARSE_RESPONSE_FILES
+ArgParse::Buffers::~Buffers() {
+	for( Buffer& buffer : this->list ) {
+#ifndef _WIN32
+		if( buffer.mapped ) {
+			munmap( buffer.data, buffer.size );
+			continue;
+		}
+#endif
+		delete[] buffer.data;
+	}
+}
+
+void ArgParse::expand( const char* path, int depth ) {
+
+	if( depth > ARGPARSE_RESPONSE_DEPTH ) {
+		throw ArgException( "Response files nested too deep at '@" + std::string( path ) + "'" );
+	}
+
+	Buffer buffer { nullptr, 0, false };
+	std::string identity;
+	size_t size = 0;
+	bool found = false;
+	bool regular = false;
+
+#ifdef _WIN32
+	FILE* file = std::fopen( path, "rb" );
+	struct _stat info;
+	char full[_MAX_PATH];
+
+	// directories can't be opened with fopen(), so check the path itself then
+	found = file ? _fstat( _fileno( file ), &info ) == 0 : _stat( path, &info ) == 0;
+	regular = found && (info.st_mode & _S_IFMT) == _S_IFREG;
+
+	if( regular ) {
+		identity = _fullpath( full, path, _MAX_PATH ) ? full : path;
+	}
+
+	if( regular && info.st_size > 0 ) {
+		size = (size_t) info.st_size;
+		buffer = { new char[size + 1], size + 1, false };
+		size = std::fread( buffer.data, 1, size, file );
+	}
+
+	if( file ) std::fclose( file );
+#else
+	int fd = open( path, O_RDONLY );
+	struct stat info;
+
+	found = fd >= 0 && fstat( fd, &info ) == 0;
+	regular = found && S_ISREG( info.st_mode );
+
+	if( regular ) {
+		identity = std::to_string( info.st_dev ) + ":" + std::to_string( info.st_ino );
+	}
+
+	if( regular && info.st_size > 0 ) {
+		size = (size_t) info.st_size;
+
+		// private writable mapping, tokens are unquoted and terminated in place,
+		// the terminator after the last token needs one byte past the end of the file,
+		// small files are just read as that's cheaper and can't SIGBUS if the file shrinks
+		if( size >= ARGPARSE_RESPONSE_MAP && size % sysconf( _SC_PAGESIZE ) != 0 ) {
+			void* map = mmap( nullptr, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+
+			if( map != MAP_FAILED ) {
+				madvise( map, size + 1, MADV_SEQUENTIAL );
+				buffer = { (char*) map, size + 1, true };
+			}
+		}
+
+		if( !buffer.data ) {
+			buffer = { new char[size + 1], size + 1, false };
+			size_t done = 0;
+
+			while( done < size ) {
+				ssize_t count = read( fd, buffer.data + done, size - done );
+				if( count <= 0 ) break;
+				done += (size_t) count;
+			}
+
+			size = done;
+		}
+	}
+
+	if( fd >= 0 ) ::close( fd );
+#endif
+
+	// unreadable file, keep the argument (including the '@' before path) as-is like compilers do
+	if( !found ) {
+		this->expanded.push_back( const_cast<char*>( path - 1 ) );
+		return;
+	}
+
+	if( buffer.data ) {
+		this->buffers->list.push_back( buffer );
+	}
+
+	if( !regular ) {
+		throw ArgException( "Response file '@" + std::string( path ) + "' is not a regular file" );
+	}
+
+	// '@self @self' would otherwise double with every level until the depth limit
+	if( std::find( this->active.begin(), this->active.end(), identity ) != this->active.end() ) {
+		throw ArgException( "Response file '@" + std::string( path ) + "' includes itself" );
+	}
+
+	if( !buffer.data ) return;
+
+	this->active.push_back( identity );
+	this->tokenize( buffer.data, size, depth );
+	this->active.pop_back();
+
+}
+
+void ArgParse::tokenize( char* data, size_t size, int depth ) {
+	char* read = data;
+	char* end = data + size;
+
+	while( read < end ) {
+
+		while( read < end && (*read == ' ' || *read == '\t' || *read == '\n' || *read == '\r') ) read ++;
+		if( read == end ) break;
+
+		// unquote the token in place, it can only get shorter
+		char* token = read;
+		char* write = read;
+		char quote = 0;
+
+		for( ; read < end; read ++ ) {
+			char c = *read;
+
+			if( quote ) {
+				if( c == quote ) quote = 0;
+				else if( c == '\\' && quote == '"' && read + 1 < end ) *write ++ = *(++ read);
+				else *write ++ = c;
+				continue;
+			}
+
+			if( c == ' ' || c == '\t' || c == '\n' || c == '\r' ) break;
+
+			if( c == '"' || c == '\'' ) quote = c;
+			else if( c == '\\' && read + 1 < end ) *write ++ = *(++ read);
+			else *write ++ = c;
+		}
+
+		*write = '\0';
+		read ++;
+
+		if( token[0] == '@' && token[1] ) {
+			this->expand( token + 1, depth + 1 );
+		}else{
+			this->expanded.push_back( token );
+		}
+
+	}
+}
+#endif
+
+// FNV-1a, also used by hasFlag() while measuring the name
+static constexpr unsigned long long __argparse_hash_basis = 14695981039346656037ull;
+static constexpr unsigned long long __argparse_hash_prime = 1099511628211ull;
+
+void ArgParse::buildIndex() {
+
+	// open addressing table of flag positions (+1, 0 is empty), kept at most half full
+	size_t size = 1;
+	while( size < this->flags.size() * 2 ) size <<= 1;
+	this->index.assign( size, 0 );
+
+	for( size_t i = 0; i < this->flags.size(); i ++ ) {
+		unsigned long long hash = __argparse_hash_basis;
+		for( char c : this->flags[i] ) hash = (hash ^ (unsigned char) c) * __argparse_hash_prime;
+
+		size_t slot = hash & (size - 1);
+		while( this->index[slot] ) slot = (slot + 1) & (size - 1);
+		this->index[slot] = (unsigned) i + 1;
+	}
+
+}
+
+bool ArgParse::lookup( const char* name, size_t length, size_t hash ) {
+	if( this->index.empty() ) return false;
+	const size_t mask = this->index.size() - 1;
+
+	for( size_t slot = hash & mask; this->index[slot]; slot = (slot + 1) & mask ) {
+		const ArgString& flag = this->flags[this->index[slot] - 1];
+		if( flag.size() == length && std::memcmp( flag.data(), name, length ) == 0 ) return true;
+	}
+
+	return false;
 }
 
 bool ArgParse::hasFlag( const char* name ) {
-	return std::find(this->flags.begin(), this->flags.end(), std::string(name)) != this->flags.end();
+	unsigned long long hash = __argparse_hash_basis;
+	size_t length = 0;
+
+	for( ; name[length]; length ++ ) hash = (hash ^ (unsigned char) name[length]) * __argparse_hash_prime;
+
+	return this->lookup( name, length, (size_t) hash );
 }
 
-bool ArgParse::isEmpty() {
-	return this->empty;
+#ifdef ARGPARSE_CXX17
+bool ArgParse::hasFlag( std::string_view name ) {
+	unsigned long long hash = __argparse_hash_basis;
+	for( char c : name ) hash = (hash ^ (unsigned char) c) * __argparse_hash_prime;
+
+	return this->lookup( name.data(), name.size(), (size_t) hash );
 }
 
-const std::string& ArgParse::getName() {
-	return this->name;
+ArgResult ArgParse::parse( const ArgSchema& schema ) {
+	ArgResult result = ArgParse::parse( schema, this->argc > 1 ? this->argv + 1 : nullptr, this->argc - 1 );
+
+#ifdef ARGPARSE_RESPONSE_FILES
+	result.arguments = this->buffers;
+#endif
+
+	return result;
 }
 
-const std::vector<std::string>& ArgParse::getFlags() {
-	return this->flags;
+ArgResult ArgParse::parse( const ArgSchema& schema, char** args, int count ) {
+	ArgResult result;
+	result.values.resize( schema.count );
+	bool options = true;
+
+	for( int i = 0; i < count; i ++ ) {
+		if( !args[i] ) continue;
+		std::string_view arg( args[i] );
+
+		if( !options || arg.size() < 2 || arg[0] != '-' ) {
+			result.positional.push_back( arg );
+			continue;
+		}
+
+		// everything after '--' is positional
+		if( arg == "--" ) {
+			options = false;
+			continue;
+		}
+
+		// long option, '--name', '--name=value' or '--name value'
+		if( arg[1] == '-' ) {
+			std::string_view key = arg.substr( 2 );
+			size_t split = key.find( '=' );
+			std::string_view name = key.substr( 0, split );
+			size_t index = schema.find( name );
+
+			if( index == schema.count ) {
+				throw ArgException( "Unknown option '--" + std::string( name ) + "'" );
+			}
+
+			const ArgOption& option = schema.options[index];
+
+			if( option.type == ARG_FLAG ) {
+				if( split != std::string_view::npos ) throw ArgException( "Option '--" + std::string( option.name ) + "' doesn't take a value" );
+				ArgParse::store( option, result.values[index], {} );
+				continue;
+			}
+
+			if( split != std::string_view::npos ) {
+				ArgParse::store( option, result.values[index], key.substr( split + 1 ) );
+			}else if( i + 1 < count && args[i + 1] ) {
+				ArgParse::store( option, result.values[index], args[++ i] );
+			}else{
+				throw ArgException( "Missing value for option '--" + std::string( option.name ) + "'" );
+			}
+
+			continue;
+		}
+
+		// short options, can be bundled '-abc', last one can take value '-ovalue' or '-o value'
+		for( size_t j = 1; j < arg.size(); j ++ ) {
+			size_t index = schema.find( arg[j] );
+
+			if( index == schema.count ) {
+				throw ArgException( std::string( "Unknown option '-" ) + arg[j] + "'" );
+			}
+
+			const ArgOption& option = schema.options[index];
+
+			if( option.type == ARG_FLAG ) {
+				ArgParse::store( option, result.values[index], {} );
+				continue;
+			}
+
+			if( j + 1 < arg.size() ) {
+				ArgParse::store( option, result.values[index], arg.substr( j + 1 ) );
+			}else if( i + 1 < count && args[i + 1] ) {
+				ArgParse::store( option, result.values[index], args[++ i] );
+			}else{
+				throw ArgException( "Missing value for option '--" + std::string( option.name ) + "'" );
+			}
+
+			break;
+		}
+	}
+
+	return result;
 }
 
-const std::vector<std::string>& ArgParse::getValues() {
-	return this->values;
+int ArgParse::dispatch( const ArgCommands& commands ) {
+	return ArgParse::dispatch( commands, this->argc, this->argv );
+}
+
+int ArgParse::dispatch( const ArgCommands& commands, int argc, char** argv ) {
+
+	if( argc < 2 || !argv[1] ) {
+		throw ArgException( "Missing command" );
+	}
+
+	size_t index = commands.find( argv[1] );
+
+	if( index == commands.count ) {
+		throw ArgException( "Unknown command '" + std::string( argv[1] ) + "'" );
+	}
+
+	// only the selected command parses its options
+	const ArgCommand& command = commands.commands[index];
+	ArgResult result;
+
+	if( command.schema ) {
+		result = ArgParse::parse( *command.schema, argv + 2, argc - 2 );
+	}else{
+		for( int i = 2; i < argc; i ++ ) {
+			if( argv[i] ) result.positional.push_back( argv[i] );
+		}
+	}
+
+	return command.handler( result );
 }
 
+std::string ArgParse::completion( const char* shell, const char* program, const ArgSchema& schema ) {
+	return ArgParse::completion( shell, program, &schema, nullptr );
+}
+
+std::string ArgParse::completion( const char* shell, const char* program, const ArgCommands& commands ) {
+	return ArgParse::completion( shell, program, nullptr, &commands );
+}
+
+std::string ArgParse::completion( const char* shell, const char* program, const ArgSchema* schema, const ArgCommands* commands ) {
+	std::string_view type( shell );
+	std::string out;
+
+	if( type == "fish" ) {
+		if( schema ) {
+			ArgParse::fishOptions( out, program, *schema, "" );
+			return out;
+		}
+
+		for( size_t i = 0; i < commands->count; i ++ ) {
+			const ArgCommand& command = commands->commands[i];
+			std::string name = ArgParse::quote( command.name, true );
+
+			// -a and -n are parsed again by fish, so the words inside are quoted twice
+			out += "complete -c " + ArgParse::quote( program, true ) + " -f -n '__fish_use_subcommand' -a " + ArgParse::quote( name, true );
+			if( command.help ) out += " -d " + ArgParse::quote( command.help, true );
+			out += '\n';
+
+			if( command.schema ) {
+				ArgParse::fishOptions( out, program, *command.schema, " -n " + ArgParse::quote( "__fish_seen_subcommand_from " + name, true ) );
+			}
+		}
+
+		return out;
+	}
+
+	if( type != "bash" && type != "zsh" ) {
+		throw ArgException( "Unsupported shell '" + std::string( shell ) + "', expected bash, zsh or fish" );
+	}
+
+	std::string function = "_";
+	for( const char* c = program; *c; c ++ ) {
+		function += std::isalnum( (unsigned char) *c ) ? *c : '_';
+	}
+
+	// zsh can run bash completion functions directly
+	if( type == "zsh" ) {
+		out += "autoload -U +X compinit && compinit\n";
+		out += "autoload -U +X bashcompinit && bashcompinit\n";
+	}
+
+	out += function + "() {\n";
+	out += "\tlocal cur=\"${COMP_WORDS[COMP_CWORD]}\" prev=\"${COMP_WORDS[COMP_CWORD-1]}\"\n";
+
+	if( schema ) {
+		ArgParse::bashOptions( out, *schema, "\t" );
+	}else{
+		out += "\tif [[ $COMP_CWORD -eq 1 ]]; then\n\t\tCOMPREPLY=()\n\t\tfor word in";
+		for( size_t i = 0; i < commands->count; i ++ ) {
+			out += ' ' + ArgParse::quote( commands->commands[i].name, false );
+		}
+		out += "; do [[ \"$word\" == \"$cur\"* ]] && COMPREPLY+=( \"$word\" ); done\n\t\treturn\n\tfi\n";
+		out += "\tcase \"${COMP_WORDS[1]}\" in\n";
+
+		for( size_t i = 0; i < commands->count; i ++ ) {
+			const ArgCommand& command = commands->commands[i];
+			out += "\t\t" + ArgParse::quote( command.name, false ) + ")\n";
+			if( command.schema ) ArgParse::bashOptions( out, *command.schema, "\t\t\t" );
+			out += "\t\t\t;;\n";
+		}
+
+		out += "\tesac\n";
+	}
+
+	out += "\tCOMPREPLY=( $(compgen -f -- \"$cur\") )\n";
+	out += "}\n";
+	out += "complete -F " + function + " " + ArgParse::quote( program, false ) + "\n";
+	return out;
+}
+
+void ArgParse::bashOptions( std::string& out, const ArgSchema& schema, const char* indent ) {
+	std::string names;
+
+	out += indent + std::string( "case \"$prev\" in\n" );
+
+	for( size_t i = 0; i < schema.count; i ++ ) {
+		const ArgOption& option = schema.options[i];
+
+		names += (i ? " --" : "--") + std::string( option.name );
+		if( option.alias ) names += std::string( " -" ) + option.alias;
+
+		// compgen -W splits on spaces, so choices are matched in a loop instead
+		if( option.type == ARG_ENUM && option.choices ) {
+			std::string_view list = option.choices;
+			std::string choices;
+
+			while( true ) {
+				size_t split = list.find( '|' );
+				choices += ' ' + ArgParse::quote( list.substr( 0, split ), false );
+
+				if( split == std::string_view::npos ) break;
+				list.remove_prefix( split + 1 );
+			}
+
+			out += indent + std::string( "\t--" ) + option.name;
+			if( option.alias ) out += std::string( "|-" ) + option.alias;
+			out += ") COMPREPLY=(); for word in" + choices + "; do [[ \"$word\" == \"$cur\"* ]] && COMPREPLY+=( \"$word\" ); done; return ;;\n";
+		}
+	}
+
+	out += indent + std::string( "esac\n" );
+	out += indent + std::string( "if [[ \"$cur\" == -* ]]; then\n" );
+	out += indent + std::string( "\tCOMPREPLY=( $(compgen -W \"" ) + names + "\" -- \"$cur\") )\n";
+	out += indent + std::string( "\treturn\n" );
+	out += indent + std::string( "fi\n" );
+}
+
+void ArgParse::fishOptions( std::string& out, const char* program, const ArgSchema& schema, const std::string& condition ) {
+	for( size_t i = 0; i < schema.count; i ++ ) {
+		const ArgOption& option = schema.options[i];
+
+		out += "complete -c " + ArgParse::quote( program, true ) + condition + " -l " + ArgParse::quote( option.name, true );
+		if( option.alias ) out += " -s " + ArgParse::quote( std::string_view( &option.alias, 1 ), true );
+		if( option.type != ARG_FLAG ) out += " -r";
+
+		if( option.type == ARG_ENUM && option.choices ) {
+			std::string_view list = option.choices;
+			std::string choices;
+
+			while( true ) {
+				size_t split = list.find( '|' );
+				choices += (choices.empty() ? "" : " ") + ArgParse::quote( list.substr( 0, split ), true );
+
+				if( split == std::string_view::npos ) break;
+				list.remove_prefix( split + 1 );
+			}
+
+			out += " -x -a " + ArgParse::quote( choices, true );
+		}
+
+		if( option.help ) out += " -d " + ArgParse::quote( option.help, true );
+
+		out += '\n';
+	}
+}
+
+// single quoted shell word, fish escapes quotes and backslashes, bash has to close the quotes
+std::string ArgParse::quote( std::string_view text, bool fish ) {
+	std::string out = "'";
+
+	for( char c : text ) {
+		if( c == '\'' ) out += fish ? "\\'" : "'\\''";
+		else if( c == '\\' && fish ) out += "\\\\";
+		else out += c;
+	}
+
+	return out + "'";
+}
+
+bool ArgParse::complete( int argc, char** argv, const ArgSchema& schema ) {
+	if( argc < 2 || !argv[1] || std::strcmp( argv[1], "--complete" ) != 0 ) return false;
+
+	// argv: program --complete [words...] current
+	std::string_view current = argc > 2 && argv[argc - 1] ? argv[argc - 1] : "";
+	std::string_view previous = argc > 3 && argv[argc - 2] ? argv[argc - 2] : "";
+
+	ArgParse::candidates( schema, previous, current );
+	return true;
+}
+
+bool ArgParse::complete( int argc, char** argv, const ArgCommands& commands ) {
+	if( argc < 2 || !argv[1] || std::strcmp( argv[1], "--complete" ) != 0 ) return false;
+
+	std::string_view current = argc > 2 && argv[argc - 1] ? argv[argc - 1] : "";
+
+	if( argc <= 3 ) {
+		for( size_t i = 0; i < commands.count; i ++ ) {
+			std::string_view name = commands.commands[i].name;
+
+			if( name.substr( 0, current.size() ) == current ) {
+				fwrite( name.data(), 1, name.size(), stdout );
+				fputc( '\n', stdout );
+			}
+		}
+
+		return true;
+	}
+
+	size_t index = argv[2] ? commands.find( argv[2] ) : commands.count;
+
+	if( index != commands.count && commands.commands[index].schema ) {
+		std::string_view previous = argc > 4 && argv[argc - 2] ? argv[argc - 2] : "";
+		ArgParse::candidates( *commands.commands[index].schema, previous, current );
+	}
+
+	return true;
+}
+
+void ArgParse::candidates( const ArgSchema& schema, std::string_view previous, std::string_view current ) {
+	auto print = [] ( std::string_view prefix, std::string_view word ) {
+		fwrite( prefix.data(), 1, prefix.size(), stdout );
+		fwrite( word.data(), 1, word.size(), stdout );
+		fputc( '\n', stdout );
+	};
+
+	auto choices = [&] ( const ArgOption& option, std::string_view prefix, std::string_view partial ) {
+		std::string_view list = option.choices ? option.choices : "";
+
+		while( true ) {
+			size_t split = list.find( '|' );
+			std::string_view choice = list.substr( 0, split );
+
+			if( choice.substr( 0, partial.size() ) == partial ) print( prefix, choice );
+
+			if( split == std::string_view::npos ) break;
+			list.remove_prefix( split + 1 );
+		}
+	};
+
+	// short option bundle '-abc', returns the option of the last letter or count if any letter is unknown
+	// or an earlier letter takes a value (so the rest is that value)
+	auto bundle = [&] ( std::string_view word ) {
+		for( size_t j = 1; j < word.size(); j ++ ) {
+			size_t index = schema.find( word[j] );
+			if( index == schema.count ) return schema.count;
+			if( j + 1 < word.size() && schema.options[index].type != ARG_FLAG ) return schema.count;
+			if( j + 1 == word.size() ) return index;
+		}
+
+		return schema.count;
+	};
+
+	// value of the previous option
+	if( previous.size() > 1 && previous[0] == '-' ) {
+		size_t index = previous[1] == '-' ? schema.find( previous.substr( 2 ) ) : bundle( previous );
+
+		if( index != schema.count && schema.options[index].type == ARG_ENUM ) {
+			choices( schema.options[index], "", current );
+			return;
+		}
+	}
+
+	if( current.empty() || current[0] != '-' ) return;
+
+	// long options, '--name=value' or a prefix of '--name'
+	if( current.substr( 0, 2 ) == "--" ) {
+		size_t split = current.find( '=' );
+
+		if( split != std::string_view::npos ) {
+			size_t index = schema.find( current.substr( 2, split - 2 ) );
+
+			if( index != schema.count && schema.options[index].type == ARG_ENUM ) {
+				choices( schema.options[index], current.substr( 0, split + 1 ), current.substr( split + 1 ) );
+			}
+
+			return;
+		}
+
+		for( size_t i = 0; i < schema.count; i ++ ) {
+			std::string_view name = schema.options[i].name;
+			if( name.substr( 0, current.size() - 2 ) == current.substr( 2 ) ) print( "--", name );
+		}
+
+		return;
+	}
+
+	// lone '-', every option in both forms
+	if( current.size() == 1 ) {
+		for( size_t i = 0; i < schema.count; i ++ ) {
+			print( "--", schema.options[i].name );
+			if( schema.options[i].alias ) print( "-", std::string_view( &schema.options[i].alias, 1 ) );
+		}
+
+		return;
+	}
+
+	// short options, '-ab' is complete if all letters are known, '-mval' completes the value
+	for( size_t j = 1; j < current.size(); j ++ ) {
+		size_t index = schema.find( current[j] );
+		if( index == schema.count ) return;
+
+		const ArgOption& option = schema.options[index];
+
+		if( option.type != ARG_FLAG && j + 1 < current.size() ) {
+			if( option.type == ARG_ENUM ) choices( option, current.substr( 0, j + 1 ), current.substr( j + 1 ) );
+			return;
+		}
+	}
+
+	print( "", current );
+}
+
+ArgResult ArgParse::resolve( const ArgSchema& schema, const char* prefix, const char* path ) {
+	ArgResult result = this->parse( schema );
+	std::string variable;
+
+	// environment, 'PREFIX_NAME' for option 'name', dashes and dots become underscores
+	for( size_t i = 0; i < schema.count && prefix; i ++ ) {
+		const ArgOption& option = schema.options[i];
+		if( result.values[i].set ) continue;
+
+		variable = prefix;
+		variable += '_';
+		for( const char* c = option.name; *c; c ++ ) {
+			variable += (*c == '-' || *c == '.') ? '_' : (char) std::toupper( (unsigned char) *c );
+		}
+
+		const char* text = std::getenv( variable.c_str() );
+		if( !text ) continue;
+
+		std::string_view value( text );
+
+		try {
+			if( option.type == ARG_FLAG ) {
+				ArgParse::storeFlag( option, result.values[i], value );
+				continue;
+			}
+
+			if( option.type == ARG_LIST ) {
+				for( size_t split; (split = value.find( ',' )) != std::string_view::npos; value.remove_prefix( split + 1 ) ) {
+					ArgParse::store( option, result.values[i], value.substr( 0, split ) );
+				}
+			}
+
+			ArgParse::store( option, result.values[i], value );
+		} catch( ArgException& error ) {
+			throw ArgException( std::string( error.what() ) + " (from " + variable + ")" );
+		}
+	}
+
+	if( path ) {
+		ArgParse::load( schema, result, path );
+	}
+
+	for( size_t i = 0; i < schema.count; i ++ ) {
+		const ArgOption& option = schema.options[i];
+
+		if( !result.values[i].set && option.fallback ) {
+			if( option.type == ARG_FLAG ) ArgParse::storeFlag( option, result.values[i], option.fallback );
+			else ArgParse::store( option, result.values[i], option.fallback );
+		}
+	}
+
+	return result;
+}
+
+void ArgParse::load( const ArgSchema& schema, ArgResult& result, const char* path ) {
+	FILE* file = fopen( path, "rb" );
+	if( !file ) return;
+
+	fseek( file, 0, SEEK_END );
+	long size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	if( size <= 0 ) {
+		fclose( file );
+		return;
+	}
+
+	// values point into this buffer, it lives as long as the result
+	result.storage.reset( new char[size] );
+	size = (long) fread( result.storage.get(), 1, size, file );
+	fclose( file );
+
+	std::string_view content( result.storage.get(), size );
+	std::string_view section;
+	std::string key;
+	int number = 0;
+
+	// not set by command line or environment, first occurrence in the file wins
+	std::vector<bool> locked( schema.count );
+	for( size_t i = 0; i < schema.count; i ++ ) locked[i] = result.values[i].set;
+
+	while( !content.empty() ) {
+		size_t split = content.find( '\n' );
+		std::string_view line = content.substr( 0, split );
+		content.remove_prefix( split == std::string_view::npos ? content.size() : split + 1 );
+		number ++;
+
+		auto trim = [] ( std::string_view text ) {
+			while( !text.empty() && std::strchr( " \t\r", text.front() ) ) text.remove_prefix( 1 );
+			while( !text.empty() && std::strchr( " \t\r", text.back() ) ) text.remove_suffix( 1 );
+			return text;
+		};
+
+		line = trim( line );
+		if( line.empty() || line[0] == '#' || line[0] == ';' ) continue;
+
+		if( line.front() == '[' && line.back() == ']' ) {
+			section = trim( line.substr( 1, line.size() - 2 ) );
+			continue;
+		}
+
+		size_t equals = line.find( '=' );
+		std::string_view name = trim( line.substr( 0, equals ) );
+		std::string_view value = equals == std::string_view::npos ? std::string_view() : trim( line.substr( equals + 1 ) );
+
+		if( value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front() ) {
+			value = value.substr( 1, value.size() - 2 );
+		}
+
+		key.assign( section.data(), section.size() );
+		if( !key.empty() ) key += '.';
+		key.append( name.data(), name.size() );
+
+		size_t index = schema.find( std::string_view( key ) );
+		std::string location = std::string( path ) + ":" + std::to_string( number );
+
+		if( index == schema.count ) {
+			throw ArgException( "Unknown option '" + key + "' in " + location );
+		}
+
+		const ArgOption& option = schema.options[index];
+		ArgValue& target = result.values[index];
+
+		if( locked[index] || (target.set && option.type != ARG_LIST) ) continue;
+
+		try {
+			if( option.type == ARG_FLAG ) {
+				ArgParse::storeFlag( option, target, equals == std::string_view::npos ? "1" : value );
+			}else{
+				ArgParse::store( option, target, value );
+			}
+		} catch( ArgException& error ) {
+			throw ArgException( std::string( error.what() ) + " in " + location );
+		}
+	}
+}
+
+void ArgParse::store( const ArgOption& option, ArgValue& value, std::string_view text ) {
+	const char* end = text.data() + text.size();
+
+	switch( option.type ) {
+
+		case ARG_FLAG:
+			value.integer ++;
+			break;
+
+		case ARG_INT: {
+			auto status = std::from_chars( text.data(), end, value.integer );
+			if( status.ec != std::errc() || status.ptr != end ) {
+				throw ArgException( "Invalid integer '" + std::string( text ) + "' for option '--" + option.name + "'" );
+			}
+			break;
+		}
+
+		case ARG_DOUBLE: {
+			auto status = std::from_chars( text.data(), end, value.real );
+			if( status.ec != std::errc() || status.ptr != end ) {
+				throw ArgException( "Invalid number '" + std::string( text ) + "' for option '--" + option.name + "'" );
+			}
+			break;
+		}
+
+		case ARG_STRING:
+			value.text = text;
+			break;
+
+		case ARG_ENUM: {
+			std::string_view choices = option.choices ? option.choices : "";
+			long long choice = 0;
+
+			while( true ) {
+				size_t split = choices.find( '|' );
+				if( choices.substr( 0, split ) == text ) break;
+
+				if( split == std::string_view::npos ) {
+					throw ArgException( "Invalid value '" + std::string( text ) + "' for option '--" + option.name + "', expected one of: " + (option.choices ? option.choices : "") );
+				}
+
+				choices.remove_prefix( split + 1 );
+				choice ++;
+			}
+
+			value.integer = choice;
+			value.text = text;
+			break;
+		}
+
+		case ARG_LIST:
+			value.list.push_back( text );
+			break;
+
+	}
+
+	value.set = true;
+}
+
+void ArgParse::storeFlag( const ArgOption& option, ArgValue& value, std::string_view text ) {
+	const char* end = text.data() + text.size();
+	std::string lower( text );
+	long long count = 0;
+
+	for( char& c : lower ) c = (char) std::tolower( (unsigned char) c );
+
+	auto status = std::from_chars( text.data(), end, count );
+
+	if( status.ec == std::errc() && status.ptr == end && count >= 0 ) {
+		// explicit count, 'TOOL_VERBOSE=3' is the same as '-vvv'
+	}else if( lower == "true" || lower == "yes" || lower == "on" ) {
+		count = 1;
+	}else if( lower.empty() || lower == "false" || lower == "no" || lower == "off" ) {
+		count = 0;
+	}else{
+		throw ArgException( "Invalid boolean '" + std::string( text ) + "' for option '--" + option.name + "'" );
+	}
+
+	// explicit false is still set (with count 0), so lower layers can't turn the flag on
+	value.integer += count;
+	value.set = true;
+}
+
+const ArgValue& ArgResult::value( size_t option ) const {
+	if( option >= this->values.size() ) {
+		throw ArgException( "Option handle " + std::to_string( option ) + " is outside of the schema" );
+	}
+
+	return this->values[option];
+}
+
+bool ArgResult::has( size_t option ) const {
+	return this->value( option ).set;
+}
+
+long long ArgResult::getInt( size_t option, long long fallback ) const {
+	const ArgValue& value = this->value( option );
+	return value.set ? value.integer : fallback;
+}
+
+double ArgResult::getDouble( size_t option, double fallback ) const {
+	const ArgValue& value = this->value( option );
+	return value.set ? value.real : fallback;
+}
+
+std::string_view ArgResult::getString( size_t option, std::string_view fallback ) const {
+	const ArgValue& value = this->value( option );
+	return value.set ? value.text : fallback;
+}
+
+const std::vector<std::string_view>& ArgResult::getList( size_t option ) const {
+	return this->value( option ).list;
+}
+
+const std::vector<std::string_view>& ArgResult::getPositional() const {
+	return this->positional;
+}
+#endif
+
+bool ArgParse::isEmpty() {
+	return this->empty;
+}
+
+const ArgString& ArgParse::getName() {
+	return this->name;
+}
+
+const std::vector<ArgString>& ArgParse::getFlags() {
+	return this->flags;
+}
+
+const std::vector<ArgString>& ArgParse::getValues() {
+	return this->values;
+}
+
+char** ArgParse::getArguments() {
+	return this->argv;
+}
+
+int ArgParse::getCount() {
+	return this->argc;
+}
+
+#ifdef ARGPARSE_FUZZ
+
+// libFuzzer entry point (AFL++ can use it with afl-clang-fast -fsanitize=fuzzer),
+// input is split on null bytes into argv and pushed through all parsing paths
+extern "C" int LLVMFuzzerTestOneInput( const unsigned char* data, size_t size ) {
+	std::vector<char> buffer( data, data + size );
+	std::vector<char*> args;
+
+	buffer.push_back( '\0' );
+	args.push_back( buffer.data() );
+
+	for( size_t i = 0; i + 1 < buffer.size(); i ++ ) {
+		if( buffer[i] == '\0' ) args.push_back( buffer.data() + i + 1 );
+	}
+
+	ArgParse argp( (int) args.size(), args.data() );
+
+	for( const ArgString& flag : argp.getFlags() ) {
+		if( !argp.hasFlag( std::string( flag ).c_str() ) ) std::abort();
+	}
+
+#ifdef ARGPARSE_CXX17
+	static constexpr ArgOption options[] = {
+		{ "flag", 'f', ARG_FLAG, "" },
+		{ "int", 'i', ARG_INT, "" },
+		{ "double", 'd', ARG_DOUBLE, "" },
+		{ "string", 's', ARG_STRING, "" },
+		{ "enum", 'e', ARG_ENUM, "", "a|bb|" },
+		{ "list", 'l', ARG_LIST, "" }
+	};
+
+	static constexpr ArgSchema schema( options );
+	static constexpr ArgCommand commands[] = {
+		{ "run", &schema, [] ( const ArgResult& result ) { return (int) result.getPositional().size(); } },
+		{ "raw", nullptr, [] ( const ArgResult& result ) { return (int) result.getPositional().size(); } }
+	};
+
+	try {
+		argp.parse( schema );
+	} catch( ArgException& error ) {}
+
+	try {
+		argp.dispatch( commands );
+	} catch( ArgException& error ) {}
+#endif
+
+	return 0;
+}
+
+#endif
+
+#if defined(ARGPARSE_BENCHMARK) || defined(ARGPARSE_TEST)
+#include "vstl.hpp"
+
+// owns synthetic argv, ArgParse keeps pointers into it
+struct __ArgparseArgs {
+
+	std::vector<std::string> strings;
+	std::vector<char*> args;
+
+	__ArgparseArgs( std::vector<std::string> list ) : strings( std::move( list ) ) {
+		for( std::string& string : this->strings ) this->args.push_back( &string[0] );
+		this->args.push_back( nullptr );
+	}
+
+	int count() {
+		return (int) this->strings.size();
+	}
+
+};
+#endif
+
+#ifdef ARGPARSE_BENCHMARK
+
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#ifndef ARGPARSE_BENCHMARK_LIMIT
+#define ARGPARSE_BENCHMARK_LIMIT 1000000
+#endif
+
+static std::atomic<size_t> __argparse_allocations {0};
+
+// counts every allocation made by the process, array forms end up here too
+void* operator new( size_t size ) {
+	__argparse_allocations.fetch_add( 1, std::memory_order_relaxed );
+	if( void* pointer = std::malloc( size ? size : 1 ) ) return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete( void* pointer ) noexcept {
+	std::free( pointer );
+}
+
+void operator delete( void* pointer, size_t ) noexcept {
+	std::free( pointer );
+}
+
+struct __ArgparseMeasure {
+
+	double nanoseconds;
+	double allocations;
+
+	// runs the callback enough times to take about 50ms and returns per call averages,
+	// vstl only times whole tests so single calls are measured here
+	template<typename F>
+	static __ArgparseMeasure run( F callback ) {
+		auto start = std::chrono::steady_clock::now();
+		size_t before = __argparse_allocations.load();
+		size_t runs = 0;
+		double elapsed;
+
+		do {
+			callback();
+			runs ++;
+			elapsed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count();
+		} while( elapsed < 50e6 );
+
+		return { elapsed / runs, (double) (__argparse_allocations.load() - before) / runs };
+	}
+
+	void print( const char* name, size_t count, size_t calls = 1 ) {
+		std::printf( "%-10s %9zu args %14.1f ns %10.1f allocs\n", name, count, this->nanoseconds / calls, this->allocations / calls );
+	}
+
+};
+
+// mix of short flags, '--name=value' flags and plain values
+static __ArgparseArgs __argparse_mixed( size_t count ) {
+	std::vector<std::string> strings { "bench" };
+	strings.reserve( count );
+
+	for( size_t i = 1; i < count; i ++ ) {
+		switch( i % 3 ) {
+			case 0: strings.push_back( "-f" + std::to_string( i ) ); break;
+			case 1: strings.push_back( "--name" + std::to_string( i ) + "=value" ); break;
+			case 2: strings.push_back( "value" + std::to_string( i ) ); break;
+		}
+	}
+
+	return __ArgparseArgs( std::move( strings ) );
+}
+
+TEST(benchmark_construct) {
+	for( size_t count = 10; count <= ARGPARSE_BENCHMARK_LIMIT; count *= 10 ) {
+		__ArgparseArgs args = __argparse_mixed( count );
+
+		__ArgparseMeasure::run( [&] () {
+			ArgParse argp( args.count(), args.args.data() );
+		} ).print( "construct", count );
+	}
+};
+
+TEST(benchmark_lookup) {
+	std::vector<std::string> missing;
+	for( size_t i = 0; i < 64; i ++ ) missing.push_back( "-missing" + std::to_string( i ) );
+
+	for( size_t count = 10; count <= ARGPARSE_BENCHMARK_LIMIT; count *= 10 ) {
+		__ArgparseArgs args = __argparse_mixed( count );
+		ArgParse argp( args.count(), args.args.data() );
+		size_t lookup = 0, wrong = 0;
+
+		// half of the lookups hit, half miss
+		__ArgparseMeasure measure = __ArgparseMeasure::run( [&] () {
+			for( size_t i = 0; i < 1024; i ++, lookup ++ ) {
+				bool hit = (lookup & 1) && count > 3;
+				const char* name = hit ? args.args[(lookup / 2) % (count / 3) * 3 + 1] : missing[lookup % missing.size()].c_str();
+				if( argp.hasFlag( name ) != hit ) wrong ++;
+			}
+		} );
+
+		measure.print( "lookup", count, 1024 );
+		CHECK( wrong, 0 );
+	}
+};
+
+#ifdef ARGPARSE_CXX17
+TEST(benchmark_schema) {
+	static constexpr ArgOption options[] = {
+		{ "verbose", 'v', ARG_FLAG, "" },
+		{ "jobs", 'j', ARG_INT, "" },
+		{ "item", 'i', ARG_LIST, "" }
+	};
+
+	static constexpr ArgSchema schema( options );
+
+	for( size_t count = 10; count <= ARGPARSE_BENCHMARK_LIMIT; count *= 10 ) {
+		std::vector<std::string> strings { "bench" };
+		strings.reserve( count );
+
+		for( size_t i = 1; i < count; i ++ ) {
+			switch( i % 4 ) {
+				case 0: strings.push_back( "-v" ); break;
+				case 1: strings.push_back( "--jobs=" + std::to_string( i ) ); break;
+				case 2: strings.push_back( "--item" ); break;
+				case 3: strings.push_back( "item" + std::to_string( i ) ); break;
+			}
+		}
+
+		__ArgparseArgs args( std::move( strings ) );
+		ArgParse argp( args.count(), args.args.data() );
+		long long verbose = 0;
+
+		__ArgparseMeasure::run( [&] () {
+			verbose = argp.parse( schema ).getInt( schema.index( "verbose" ) );
+		} ).print( "schema", count );
+
+		CHECK( verbose, (long long) ((count - 1) / 4) );
+	}
+};
+#endif
+
+#endif
+
+#ifdef ARGPARSE_TEST
+
+static void __argparse_write( const char* path, const char* content ) {
+	FILE* file = std::fopen( path, "wb" );
+	ASSERT( file );
+	std::fputs( content, file );
+	std::fclose( file );
+}
+
+static void __argparse_setenv( const char* name, const char* value ) {
+#ifdef _WIN32
+	_putenv_s( name, value ? value : "" );
+#else
+	if( value ) setenv( name, value, 1 );
+	else unsetenv( name );
+#endif
+}
+
+TEST(flags) {
+	__ArgparseArgs args( { "tool", "-a", "--bb", "value", "-a" } );
+	ArgParse argp( args.count(), args.args.data() );
+
+	ASSERT( argp.hasFlag( "-a" ) );
+	ASSERT( argp.hasFlag( "--bb" ) );
+	ASSERT( !argp.hasFlag( "-b" ) );
+	ASSERT( !argp.hasFlag( "value" ) );
+	CHECK( argp.getFlags().size(), 3 );
+	CHECK( argp.getValues().size(), 1 );
+};
+
+#ifdef ARGPARSE_CXX17
+static constexpr ArgOption __argparse_options[] = {
+	{ "verbose", 'v', ARG_FLAG, "Print more" },
+	{ "jobs", 'j', ARG_INT, "Number of threads" },
+	{ "scale", 's', ARG_DOUBLE, "Scale" },
+	{ "name", 'n', ARG_STRING, "Name" },
+	{ "mode", 'm', ARG_ENUM, "Mode", "debug|release" },
+	{ "item", 'i', ARG_LIST, "Items" },
+	{ "color", 0, ARG_FLAG, "Use colors" },
+	{ "level", 0, ARG_INT, "Level", nullptr, "7" }
+};
+
+static constexpr ArgSchema __argparse_schema( __argparse_options );
+
+TEST(schema_lookup) {
+	constexpr size_t jobs = __argparse_schema.index( "jobs" );
+	static_assert( jobs == 1, "index() is constexpr" );
+
+	CHECK( __argparse_schema.find( "mode" ), 4 );
+	CHECK( __argparse_schema.find( 'm' ), 4 );
+	CHECK( __argparse_schema.find( "missing" ), __argparse_schema.count );
+	CHECK( __argparse_schema.find( '\0' ), __argparse_schema.count );
+	EXPECT( ArgException, __argparse_schema.index( "missing" ) );
+
+	ArgResult result;
+	EXPECT( ArgException, result.getInt( 0 ) );
+};
+
+TEST(schema_parse) {
+	__ArgparseArgs args( { "tool", "-vv", "--jobs=4", "-nfoo", "--mode", "release", "-i", "a", "--item=b", "file", "--", "-v" } );
+	ArgParse argp( args.count(), args.args.data() );
+	ArgResult result = argp.parse( __argparse_schema );
+
+	CHECK( result.getInt( 0 ), 2 );
+	CHECK( result.getInt( 1 ), 4 );
+	CHECK( result.getString( 3 ), "foo" );
+	CHECK( result.getInt( 4 ), 1 );
+	CHECK( result.getList( 5 ).size(), 2 );
+	CHECK( result.getList( 5 )[1], "b" );
+	CHECK( result.getPositional().size(), 2 );
+	CHECK( result.getPositional()[1], "-v" );
+	ASSERT( !result.has( 2 ) );
+
+	__ArgparseArgs unknown( { "tool", "--missing" } );
+	EXPECT( ArgException, ArgParse( unknown.count(), unknown.args.data() ).parse( __argparse_schema ) );
+
+	__ArgparseArgs choice( { "tool", "--mode=fast" } );
+	EXPECT( ArgException, ArgParse( choice.count(), choice.args.data() ).parse( __argparse_schema ) );
+};
+
+TEST(schema_numbers) {
+	__ArgparseArgs args( { "tool", "-j", "-12", "--scale=2.5e3" } );
+	ArgResult result = ArgParse( args.count(), args.args.data() ).parse( __argparse_schema );
+
+	CHECK( result.getInt( 1 ), -12 );
+	CHECK( result.getDouble( 2 ), 2500.0 );
+
+	for( const char* text : { "--jobs=", "--jobs=12x", "--jobs=0x10", "--jobs=99999999999999999999", "--scale=1.5.5", "--scale=abc" } ) {
+		__ArgparseArgs invalid( { "tool", text } );
+		EXPECT( ArgException, ArgParse( invalid.count(), invalid.args.data() ).parse( __argparse_schema ) );
+	}
+};
+
+TEST(layering) {
+	const char* path = "argparse-test.ini";
+	__argparse_write( path, "jobs = 3\nname = file\n[mode]\n\n[]\nitem = x\nitem = y\n" );
+	__argparse_setenv( "ARGPARSE_TEST_JOBS", "5" );
+	__argparse_setenv( "ARGPARSE_TEST_SCALE", "0.5" );
+	__argparse_setenv( "ARGPARSE_TEST_ITEM", nullptr );
+
+	__ArgparseArgs args( { "tool", "--scale=2" } );
+	ArgResult result = ArgParse( args.count(), args.args.data() ).resolve( __argparse_schema, "ARGPARSE_TEST", path );
+
+	// command line, then environment, then file, then fallback
+	CHECK( result.getDouble( 2 ), 2.0 );
+	CHECK( result.getInt( 1 ), 5 );
+	CHECK( result.getString( 3 ), "file" );
+	CHECK( result.getList( 5 ).size(), 2 );
+	CHECK( result.getInt( 7 ), 7 );
+
+	// values from the file stay valid in copies of the result
+	ArgResult copy = result;
+	result = ArgResult();
+	CHECK( copy.getString( 3 ), "file" );
+
+	__argparse_write( path, "missing = 1\n" );
+	EXPECT( ArgException, ArgParse( args.count(), args.args.data() ).resolve( __argparse_schema, "ARGPARSE_TEST", path ) );
+
+	__argparse_setenv( "ARGPARSE_TEST_JOBS", nullptr );
+	__argparse_setenv( "ARGPARSE_TEST_SCALE", nullptr );
+	std::remove( path );
+};
+
+TEST(layering_flags) {
+	static constexpr ArgOption options[] = {
+		{ "verbose", 'v', ARG_FLAG, "", nullptr, "true" },
+		{ "color", 0, ARG_FLAG, "" },
+		{ "debug", 0, ARG_FLAG, "", nullptr, "yes" }
+	};
+
+	static constexpr ArgSchema schema( options );
+	const char* path = "argparse-test.ini";
+	__argparse_write( path, "color = true\ndebug\n" );
+
+	// explicit false from a higher layer wins over file and fallback
+	__argparse_setenv( "ARGPARSE_TEST_VERBOSE", "0" );
+	__argparse_setenv( "ARGPARSE_TEST_COLOR", "false" );
+	__argparse_setenv( "ARGPARSE_TEST_DEBUG", "off" );
+
+	__ArgparseArgs args( { "tool" } );
+	ArgResult result = ArgParse( args.count(), args.args.data() ).resolve( schema, "ARGPARSE_TEST", path );
+
+	ASSERT( result.has( 0 ) );
+	CHECK( result.getInt( 0, 1 ), 0 );
+	CHECK( result.getInt( 1, 1 ), 0 );
+	CHECK( result.getInt( 2, 1 ), 0 );
+
+	// without environment the file and fallback apply, counts add up
+	__argparse_setenv( "ARGPARSE_TEST_VERBOSE", "2" );
+	__argparse_setenv( "ARGPARSE_TEST_COLOR", nullptr );
+	__argparse_setenv( "ARGPARSE_TEST_DEBUG", nullptr );
+	__argparse_write( path, "color = no\n" );
+
+	result = ArgParse( args.count(), args.args.data() ).resolve( schema, "ARGPARSE_TEST", path );
+	CHECK( result.getInt( 0 ), 2 );
+	CHECK( result.getInt( 1, 1 ), 0 );
+	CHECK( result.getInt( 2 ), 1 );
+
+	__argparse_setenv( "ARGPARSE_TEST_VERBOSE", "maybe" );
+	EXPECT( ArgException, ArgParse( args.count(), args.args.data() ).resolve( schema, "ARGPARSE_TEST", path ) );
+
+	__argparse_setenv( "ARGPARSE_TEST_VERBOSE", nullptr );
+	std::remove( path );
+};
+
+TEST(completion_quoting) {
+	static constexpr ArgOption options[] = {
+		{ "mode", 'm', ARG_ENUM, "It's a mode", "fast|two words|it's" }
+	};
+
+	static constexpr ArgSchema schema( options );
+	std::string bash = ArgParse::completion( "bash", "my tool", schema );
+	std::string fish = ArgParse::completion( "fish", "my tool", schema );
+
+	ASSERT( bash.find( "for word in 'fast' 'two words' 'it'\\''s';" ) != std::string::npos );
+	ASSERT( bash.find( "complete -F _my_tool 'my tool'" ) != std::string::npos );
+	ASSERT( fish.find( "complete -c 'my tool' -l 'mode' -s 'm'" ) != std::string::npos );
+	ASSERT( fish.find( "-a '\\'fast\\' \\'two words\\' \\'it\\\\\\'s\\'' -d 'It\\'s a mode'" ) != std::string::npos );
+	EXPECT( ArgException, ArgParse::completion( "tcsh", "tool", schema ) );
+};
+#endif
+
+#ifdef ARGPARSE_RESPONSE_FILES
+TEST(response_files) {
+	__argparse_write( "argparse-test.rsp", "-a 'two words' \"es\\\"caped\"\n@argparse-test-nested.rsp\n" );
+	__argparse_write( "argparse-test-nested.rsp", "-b\tlast" );
+
+	__ArgparseArgs args( { "tool", "first", "@argparse-test.rsp", "@argparse-test-missing.rsp" } );
+	ArgParse argp( args.count(), args.args.data() );
+
+	CHECK( argp.getCount(), 8 );
+	CHECK( std::string( argp.getArguments()[3] ), "two words" );
+	CHECK( std::string( argp.getArguments()[4] ), "es\"caped" );
+	CHECK( std::string( argp.getArguments()[7] ), "@argparse-test-missing.rsp" );
+	ASSERT( argp.hasFlag( "-a" ) );
+	ASSERT( argp.hasFlag( "-b" ) );
+
+#ifdef ARGPARSE_CXX17
+	static constexpr ArgOption options[] = {
+		{ "all", 'a', ARG_FLAG, "" },
+		{ "bee", 'b', ARG_FLAG, "" }
+	};
+
+	static constexpr ArgSchema schema( options );
+
+	// the result keeps the file contents alive
+	ArgResult result = ArgParse( args.count(), args.args.data() ).parse( schema );
+	CHECK( result.getPositional().size(), 5 );
+	CHECK( result.getPositional()[1], "two words" );
+	CHECK( result.getPositional()[3], "last" );
+#endif
+
+	__argparse_write( "argparse-test-nested.rsp", "@argparse-test.rsp" );
+	EXPECT( ArgException, ArgParse( args.count(), args.args.data() ) );
+
+	std::remove( "argparse-test.rsp" );
+	std::remove( "argparse-test-nested.rsp" );
+};
+#endif
+
+#endif
+
+#if defined(ARGPARSE_BENCHMARK) || defined(ARGPARSE_TEST)
+BEGIN(VSTL_MODE_LENIENT)
+#endif
+
 #undef ARGPARSE_IMPLEMENT
 #endif
 
@@ -35,121 +35,2627 @@
  * Usage:
  * 	DynamicLibrary dl( "./path/to/lib" );
  * 	if( dl.isLoaded() ) {
- * 		auto funcptr = dl.fetch<void(int,int)>( "funcname" );
+ * 		auto funcptr = dl.fetch<void(*)(int,int)>( "funcname" );
  * 		// ... //
  * 	}else{
- * 		std::cout << dl.getMessage();
+ * 		std::cout << dl.getMessage() << ": " << DynamicLibrary::getError();
  * 		dl.close(); // optional - automatically called by destructor
  * 	}
  */
 
+/*
+ * Ownership:
+ * 	DynamicLibrary is a reference counted handle, copies share the same loaded
+ * 	library which is closed when the last copy is closed or destroyed. Copies can be
+ * 	passed to and used from different threads freely, a single object shared between
+ * 	threads must not be closed or assigned to while it is in use (same rules as std::shared_ptr).
+ *
+ * 	DynamicLibrary::State:
+ * 	LOADED - library is open, fetch() can be used
+ * 	FAILED - library could not be loaded, see DynamicLibrary::getError()
+ * 	CLOSED - close() was called
+ * 	MOVED  - library was moved to a different object
+ *
+ * 	getError() returns the loader message of the last failed load on the calling thread.
+ */
+
+/*
+ * Load options: (can be combined with |, ignored on Windows)
+ * 	DynamicLibrary::LAZY     - resolve functions on first call (default)
+ * 	DynamicLibrary::NOW      - resolve all symbols when loading (RTLD_NOW)
+ * 	DynamicLibrary::LOCAL    - don't share symbols with later libraries (default)
+ * 	DynamicLibrary::GLOBAL   - make symbols available to later libraries (RTLD_GLOBAL)
+ * 	DynamicLibrary::NODELETE - keep library mapped after close (RTLD_NODELETE)
+ * 	DynamicLibrary::DEEPBIND - prefer own symbols over global ones (RTLD_DEEPBIND)
+ * 	DynamicLibrary::PREFAULT - read executable pages in when loading
+ *
+ * 	DynamicLibrary dl( "./plugin.so", DynamicLibrary::NOW | DynamicLibrary::PREFAULT );
+ *
+ * 	NOW | PREFAULT moves symbol resolution and page faults of the code
+ * 	from the first calls into the library to the constructor.
+ */
+
+/*
+ * Binding:
+ * 	struct PluginApi {
+ * 		int (*init)();
+ * 		void (*run)(int);
+ * 	} api;
+ *
+ * 	SymbolBinder binder( dl );
+ * 	binder.bind( api.init, "init" ).bind( api.run, "run" );
+ * 	if( !binder.isComplete() ) {
+ * 		for( const char* name : binder.getMissing() ) std::cout << "missing: " << name << "\n";
+ * 	}
+ *
+ * 	api.run(42); // plain call through the table, no lookup
+ */
+
+/*
+ * Introspection: (Linux only)
+ * 	LibraryInfo info( "./plugin.so" ); // the library is not loaded or run
+ * 	if( info.isValid() ) {
+ * 		for( const char* name : info.getNeeded() ) std::cout << "needs " << name << "\n";
+ * 		for( const LibrarySymbol& symbol : info.getSymbols() ) {
+ * 			std::cout << symbol.name << (symbol.version ? "@" : "") << (symbol.version ? symbol.version : "") << "\n";
+ * 		}
+ *
+ * 		// resolve all symbols that follow a naming convention in one go
+ * 		std::vector<const LibrarySymbol*> handlers = info.find( "handler_" );
+ * 		std::vector<void*> addresses = dl.fetchAll( handlers );
+ * 	}
+ *
+ * 	The file is mapped and only the dynamic section and the tables it points to are read,
+ * 	names point into the mapping and stay valid for the lifetime of the LibraryInfo.
+ * 	Files built for a different machine, ELF class or byte order are rejected.
+ * 	fetchAll() computes addresses from the symbol table instead of looking up every
+ * 	name, it checks the first and last address against dlsym() and falls back to dlsym()
+ * 	if the loaded library doesn't match the file. Thread local, indirect (IFUNC) and
+ * 	hidden symbols are always resolved by the loader.
+ */
+
+/*
+ * Profiling: (LIBLOAD_PROFILE)
+ * 	auto run = dl.fetchProfiled<void(*)(int)>( "run" );
+ * 	run(42); // timed call
+ *
+ * 	LibraryProfiler::dump( stderr ); // call periodically, for example once a second
+ *
+ * 	library              symbol                      calls      calls/s          p50          p99
+ * 	libplugin.so         run                       1204455     401485.0      0.210us      1.140us
+ *
+ * 	Without LIBLOAD_PROFILE fetchProfiled() is the same as fetch() and returns
+ * 	the raw function pointer, so use auto to hold the result. With profiling enabled
+ * 	every call records its latency (in TSC ticks on x86) into a per-thread histogram shard,
+ * 	report() and dump() aggregate the shards and show the values since the previous report.
+ * 	Profiles are kept per library path and symbol name, so the same name fetched from two
+ * 	different libraries is reported separately.
+ */
+
+/*
+ * Hot reload: (LIBLOAD_HOT_RELOAD, Linux only, link with -pthread)
+ * 	bool bind( DynamicLibrary& dl, PluginApi& api ) {
+ * 		return SymbolBinder( dl ).bind( api.init, "init" ).bind( api.run, "run" ).isComplete();
+ * 	}
+ *
+ * 	ReloadableLibrary<PluginApi> plugin( "./plugin.so", bind );
+ * 	plugin.watch(); // reload automatically when the file changes
+ *
+ * 	// on request threads
+ * 	auto api = plugin.acquire();
+ * 	if( api ) api->run(42);
+ *
+ * 	New version is loaded next to the old one (from a private copy of the file, kept in a
+ * 	memfd or next to the original if that fails) and the table is swapped atomically, old
+ * 	version is closed only after all guards that could see it are gone. acquire() doesn't
+ * 	lock for the first LIBLOAD_MAX_READERS threads, later ones take a slower locked path.
+ * 	Guards should be short lived, can be nested and must be destroyed on the thread that
+ * 	acquired them (checked with assert()). The destructor waits for all guards, a library
+ * 	destroyed on a thread that still holds any guard (of any ReloadableLibrary) would wait
+ * 	forever, so that asserts and without asserts leaks the remaining versions instead.
+ */
+
+/*
+ * Directory loader: (LIBLOAD_LOADER, Linux only, link with -pthread)
+ * 	LibraryLoader loader( "./plugins", DynamicLibrary::NOW );
+ * 	for( LoadedLibrary& entry : loader.getLibraries() ) {
+ * 		std::cout << entry.name << " level " << entry.level << ": " << entry.milliseconds << "ms\n";
+ * 	}
+ *
+ * 	DynamicLibrary* dl = loader.find( "libfoo.so" );
+ *
+ * 	Every .so file in the directory is loaded, libraries are ordered by their DT_NEEDED
+ * 	entries so that a plugin is opened only after the plugins it links against. Files are
+ * 	read into the page cache and parsed on a thread pool, independent libraries of each
+ * 	level are then opened concurrently. Note that glibc serializes the dlopen() calls
+ * 	themselves on its loader lock, so most of the gain comes from the parallel file reads.
+ */
+
+/*
+ * Sandbox: (LIBLOAD_SANDBOX, Linux only)
+ * 	SandboxedLibrary sandbox( "./plugin.so" );
+ * 	if( sandbox.isLoaded() ) {
+ * 		auto add = sandbox.fetch<int(*)(int,int)>( "add" );
+ * 		int sum = add(1, 2);
+ *
+ * 		if( SandboxedLibrary::getCallStatus() == SandboxedLibrary::CALL_CRASHED ) {
+ * 			// plugin crashed during this call and was restarted, sum is 0
+ * 		}
+ * 	}else{
+ * 		std::cout << sandbox.getMessage();
+ * 	}
+ *
+ * 	The library is loaded in a child process, calls are passed through a ring of
+ * 	shared memory slots and futex wakeups. Arguments and results are copied by value so
+ * 	they need to be trivially copyable, pointers are meaningless on the other side.
+ * 	A crash fails only the call that was running, the process is restarted and the
+ * 	calls that were waiting are executed by the new one. Create sandboxes before starting
+ * 	other threads, the host process is forked from the constructor. If the supervisor
+ * 	process itself dies (killed from outside, or because the thread that created the
+ * 	sandbox exited) waiting calls fail with CALL_CRASHED and the sandbox stops being loaded.
+ * 	The destructor waits LIBLOAD_SANDBOX_SHUTDOWN milliseconds for a running call to return
+ * 	and then kills the processes.
+ */
+
+/*
+ * Benchmark: (LIBLOAD_BENCHMARK with LIBLOAD_IMPLEMENT, Linux only)
+ * 	g++ -x c++ -O2 -DLIBLOAD_LINUX -DLIBLOAD_IMPLEMENT -DLIBLOAD_BENCHMARK -DLIBLOAD_HOT_RELOAD libload.hpp -o bench -ldl -pthread
+ * 	./bench [libraries=200] [symbols=64] [threads=4]
+ *
+ * 	Defines main(), generates synthetic libraries in a temporary directory (compiled once with
+ * 	$CC or cc, then copied) and measures open, fetch, fetchAll(), lookups in the cached table
+ * 	returned by fetchAll(), calls and close, then the same lookups from multiple threads,
+ * 	concurrent open/close and, with LIBLOAD_HOT_RELOAD, calls through a ReloadableLibrary
+ * 	while it is being replaced. Every fetched function is called
+ * 	and checked, the exit code is non zero if anything returned a wrong value.
+ */
+
 #ifndef LIB_LIBLOAD_HPP_
 #define LIB_LIBLOAD_HPP_
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <cstring>
+
+#if defined(LIBLOAD_HOT_RELOAD) && defined(LIBLOAD_LINUX)
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <set>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+
+#ifndef LIBLOAD_MAX_READERS
+#define LIBLOAD_MAX_READERS 256
+#endif
+#endif
+
+#if defined(LIBLOAD_LOADER) && defined(LIBLOAD_LINUX)
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(LIBLOAD_SANDBOX) && defined(LIBLOAD_LINUX)
+#include <new>
+#include <mutex>
+#include <tuple>
+#include <cerrno>
+#include <cstdio>
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifndef LIBLOAD_SANDBOX_SLOTS
+#define LIBLOAD_SANDBOX_SLOTS 64
+#endif
+
+#ifndef LIBLOAD_SANDBOX_PAYLOAD
+#define LIBLOAD_SANDBOX_PAYLOAD 256
+#endif
+
+#ifndef LIBLOAD_SANDBOX_SYMBOLS
+#define LIBLOAD_SANDBOX_SYMBOLS 256
+#endif
+
+#ifndef LIBLOAD_SANDBOX_NAME
+#define LIBLOAD_SANDBOX_NAME 64
+#endif
+
+#ifndef LIBLOAD_SANDBOX_SHUTDOWN
+#define LIBLOAD_SANDBOX_SHUTDOWN 1000
+#endif
+#endif
+
+#ifdef LIBLOAD_PROFILE
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define __LIBLOAD_TSC 1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define __LIBLOAD_TSC 1
+#endif
+
+#ifndef LIBLOAD_PROFILE_SHARDS
+#define LIBLOAD_PROFILE_SHARDS 16
+#endif
+
+// log2 buckets split into 4 linear steps each
+#define __LIBLOAD_BUCKETS 252
+
+struct __LibloadShard {
+	std::atomic<uint64_t> buckets[__LIBLOAD_BUCKETS];
+	char padding[64];
+};
+
+struct __LibloadProfile {
+	const char* library;
+	const char* name;
+	__LibloadShard shards[LIBLOAD_PROFILE_SHARDS];
+
+	// totals at the previous report, guarded by the registry lock
+	uint64_t snapshot[__LIBLOAD_BUCKETS];
+
+	static __LibloadProfile* get( const std::string& library, const char* name );
+
+	static inline uint64_t tick() {
+#ifdef __LIBLOAD_TSC
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+	}
+
+	static inline unsigned bucket( uint64_t ticks ) {
+		if( ticks < 4 ) return (unsigned) ticks;
+
+#ifdef __GNUC__
+		unsigned exponent = 63 - __builtin_clzll( ticks );
+#else
+		unsigned exponent = 63;
+		while( !(ticks >> exponent) ) exponent --;
+#endif
+
+		return (exponent - 1) * 4 + ((ticks >> (exponent - 2)) & 3);
+	}
+
+	// every thread sticks to one shard so that shards are almost never shared
+	static inline unsigned shard() {
+		static std::atomic<unsigned> next {0};
+		static thread_local unsigned index = next.fetch_add( 1, std::memory_order_relaxed ) % LIBLOAD_PROFILE_SHARDS;
+		return index;
+	}
+
+	inline void record( uint64_t ticks ) {
+		this->shards[shard()].buckets[bucket( ticks )].fetch_add( 1, std::memory_order_relaxed );
+	}
+};
+
+template<typename T>
+class ProfiledSymbol;
+
+template<typename R, typename... A>
+class ProfiledSymbol<R(*)(A...)> {
+
+	public:
+		ProfiledSymbol( R(*function)(A...), __LibloadProfile* profile )
+		: function( function ), profile( profile ) {}
+
+		R operator()( A... args ) const {
+			Timer timer( this->profile );
+			return this->function( std::forward<A>( args )... );
+		}
+
+		explicit operator bool() const {
+			return this->function != nullptr;
+		}
+
+		R (*get() const)(A...) {
+			return this->function;
+		}
+
+	private:
+		struct Timer {
+			__LibloadProfile* profile;
+			uint64_t start;
+
+			Timer( __LibloadProfile* profile ) : profile( profile ), start( __LibloadProfile::tick() ) {}
+			~Timer() { this->profile->record( __LibloadProfile::tick() - this->start ); }
+		};
+
+		R (*function)(A...);
+		__LibloadProfile* profile;
+
+};
+
+struct ProfileReport {
+	const char* library;
+	const char* name;
+	uint64_t calls;
+	double rate;
+	double p50;
+	double p99;
+};
+
+class LibraryProfiler {
+
+	public:
+		static std::vector<ProfileReport> report();
+		static void dump( FILE* out = stderr );
+
+};
+#endif
 
 struct __DynLibData;
 
+#ifdef LIBLOAD_LINUX
+struct LibrarySymbol;
+#endif
+
 #ifdef LIBLOAD_WINDOWS
 #include <windows.h>
 
 struct __DynLibData {
 	HINSTANCE handle;
+	std::atomic<unsigned> references;
 };
 #endif
 
 #ifdef LIBLOAD_LINUX
 #include <dlfcn.h>
+#include <link.h>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ELF identification of the running process, LibraryInfo rejects files built for something else
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#	define __LIBLOAD_ELF_DATA ELFDATA2MSB
+#else
+#	define __LIBLOAD_ELF_DATA ELFDATA2LSB
+#endif
+
+#if defined(__x86_64__)
+#	define __LIBLOAD_ELF_MACHINE EM_X86_64
+#elif defined(__i386__)
+#	define __LIBLOAD_ELF_MACHINE EM_386
+#elif defined(__aarch64__)
+#	define __LIBLOAD_ELF_MACHINE EM_AARCH64
+#elif defined(__arm__)
+#	define __LIBLOAD_ELF_MACHINE EM_ARM
+#elif defined(__riscv)
+#	define __LIBLOAD_ELF_MACHINE EM_RISCV
+#elif defined(__powerpc64__)
+#	define __LIBLOAD_ELF_MACHINE EM_PPC64
+#elif defined(__powerpc__)
+#	define __LIBLOAD_ELF_MACHINE EM_PPC
+#elif defined(__s390x__)
+#	define __LIBLOAD_ELF_MACHINE EM_S390
+#endif
 
 struct __DynLibData {
 	void* handle;
+	std::atomic<unsigned> references;
 };
 #endif
 
 class DynamicLibrary {
 
 	public:
-		DynamicLibrary( const char* path );
+		enum Flags {
+			LAZY = 0,
+			LOCAL = 0,
+			NOW = 1,
+			GLOBAL = 2,
+			NODELETE = 4,
+			DEEPBIND = 8,
+			PREFAULT = 16
+		};
+
+		enum State : unsigned char {
+			LOADED,
+			FAILED,
+			CLOSED,
+			MOVED
+		};
+
+		DynamicLibrary( const char* path, int flags = LAZY );
+		DynamicLibrary( const DynamicLibrary& dl );
 		DynamicLibrary( DynamicLibrary&& dl );
 		~DynamicLibrary();
 
+		DynamicLibrary& operator=( const DynamicLibrary& dl );
+		DynamicLibrary& operator=( DynamicLibrary&& dl );
+
 		void close();
-		bool isLoaded();
-		std::string& getMessage();
+		bool isLoaded() const;
+		State getState() const;
+		const char* getMessage() const;
+		unsigned getReferences() const;
+
+		static const char* getError();
 
 		template<typename T>
-		T fetch( const char* name );
+		T fetch( const char* name ) const;
+
+#ifdef LIBLOAD_PROFILE
+		template<typename T>
+		ProfiledSymbol<T> fetchProfiled( const char* name ) const;
+#else
+		template<typename T>
+		T fetchProfiled( const char* name ) const;
+#endif
+
+#ifdef LIBLOAD_LINUX
+		std::vector<void*> fetchAll( const std::vector<const LibrarySymbol*>& symbols ) const;
+#endif
 
 	private:
-		__DynLibData data;
-		std::string status = "";
+		__DynLibData* data = nullptr;
+		State state = FAILED;
+
+		void* address( const char* name ) const;
+		void prefault();
+
+#ifdef LIBLOAD_PROFILE
+		std::string location() const;
+#endif
 
 };
 
-#ifdef LIBLOAD_IMPLEMENT
+class SymbolBinder {
 
-DynamicLibrary::DynamicLibrary( const char* path ) {
+	public:
+		SymbolBinder( DynamicLibrary& dl );
 
-#ifdef LIBLOAD_WINDOWS
-	this->data.handle = LoadLibrary( TEXT(path) );
-	if( !this->data.handle ) this->status = "null handle";
-#endif
+		template<typename T>
+		SymbolBinder& bind( T& slot, const char* name );
+
+		bool isComplete();
+		const std::vector<const char*>& getMissing();
+
+	private:
+		DynamicLibrary& library;
+		std::vector<const char*> missing;
+
+};
 
 #ifdef LIBLOAD_LINUX
-	this->data.handle = dlopen(path, RTLD_LAZY);
-	if( !this->data.handle ) this->status = dlerror();
-#endif
 
-}
+struct LibrarySymbol {
+	const char* name;
+	const char* version;
+	uintptr_t value;
+	size_t size;
+	unsigned char type;
+	bool hidden;
 
-DynamicLibrary::DynamicLibrary( DynamicLibrary&& dl ) {
-	this->data = std::move( dl.data );
-	this->status = dl.status;
-	dl.status = "library ownership moved";
-}
+	bool isFunction() const {
+		return this->type == STT_FUNC || this->type == STT_GNU_IFUNC;
+	}
+};
 
-DynamicLibrary::~DynamicLibrary() {
-	this->close();
-}
+class LibraryInfo {
 
-std::string& DynamicLibrary::getMessage() {
-	return this->status;
-}
+	public:
+		LibraryInfo( const char* path, bool prefetch = false );
+		LibraryInfo( LibraryInfo&& info );
+		LibraryInfo( const LibraryInfo& info ) = delete;
+		~LibraryInfo();
 
-bool DynamicLibrary::isLoaded() {
-	return this->status.empty();
-}
+		bool isValid() const;
+		const char* getMessage() const;
+		const char* getSoname() const;
+		const std::vector<const char*>& getNeeded() const;
+		const std::vector<LibrarySymbol>& getSymbols() const;
+		std::vector<const LibrarySymbol*> find( const char* prefix ) const;
 
-void DynamicLibrary::close() {
-	if( this->isLoaded() ) {
-		this->status = "library unloaded";
+	private:
+		const char* base = nullptr;
+		size_t size = 0;
+		const char* status = "";
+		const char* soname = "";
+		std::vector<const char*> needed;
+		std::vector<LibrarySymbol> symbols;
 
-#ifdef LIBLOAD_WINDOWS
-		FreeLibrary( this->data.handle );
-#endif
+		const char* address( ElfW(Addr) address, size_t length ) const;
+		const char* parse();
+
+};
 
-#ifdef LIBLOAD_LINUX
-		dlclose(this->data.handle);
 #endif
 
-	}
-}
+#if defined(LIBLOAD_HOT_RELOAD) && defined(LIBLOAD_LINUX)
 
-template <typename T> T DynamicLibrary::fetch( const char* name ) {
-	if( this->isLoaded() ) {
+// epoch based reclamation shared by all reloadable libraries,
+// readers publish the epoch they started in, zero means not reading
+struct __LibloadEpoch {
+
+	static unsigned enter();
+	static void exit( unsigned slot );
+	static uint64_t advance();
+	static bool quiescent( uint64_t epoch );
+	static bool reading();
+
+};
+
+template<typename T>
+class ReloadableLibrary {
+
+	public:
+		typedef bool (*Binding) ( DynamicLibrary& dl, T& table );
+
+		class Guard {
+
+			public:
+				Guard( const T* table, unsigned slot );
+				Guard( Guard&& guard );
+				~Guard();
+
+				const T* operator->() const;
+				const T& operator*() const;
+				explicit operator bool() const;
+
+			private:
+				const T* table;
+				unsigned slot;
+
+		};
+
+		ReloadableLibrary( const char* path, Binding binding, int flags = DynamicLibrary::LAZY );
+		~ReloadableLibrary();
+
+		bool isLoaded();
+		bool reload();
+		void watch();
+		unsigned getGeneration();
+		std::string getMessage();
+
+		Guard acquire();
+
+	private:
+		struct Version {
+			Version( const char* path, int flags, int fd ) : library( path, flags ), fd( fd ) {}
+
+			// the memfd is kept open so that its /proc/self/fd path can't be reused while loaded
+			~Version() {
+				library.close();
+				if( fd >= 0 ) ::close( fd );
+			}
+
+			DynamicLibrary library;
+			int fd;
+			T table;
+			uint64_t retired = 0;
+		};
+
+		std::string path;
+		Binding binding;
+		int flags;
+		std::atomic<Version*> current;
+		std::atomic<bool> running;
+		std::atomic<unsigned> generation;
+		std::vector<Version*> retired;
+		std::string status;
+		std::mutex mutex;
+		std::thread watcher;
+
+		Version* load();
+		int copy( std::string& temp );
+		void reclaim();
+		void run();
+
+};
 
-#ifdef LIBLOAD_WINDOWS
-		return reinterpret_cast<T>( GetProcAddress( this->data.handle, name ) );
 #endif
 
-#ifdef LIBLOAD_LINUX
-		return reinterpret_cast<T>( dlsym( this->data.handle, name ) );
+#if defined(LIBLOAD_LOADER) && defined(LIBLOAD_LINUX)
+
+struct LoadedLibrary {
+	std::string name;
+	std::string path;
+	std::string soname;
+	std::vector<std::string> needed;
+	std::unique_ptr<DynamicLibrary> library;
+	std::string error;
+	unsigned level = 0;
+	double milliseconds = 0;
+};
+
+class LibraryLoader {
+
+	public:
+		LibraryLoader( const char* directory, int flags = DynamicLibrary::LAZY, unsigned threads = 0 );
+
+		bool isComplete();
+		std::string& getMessage();
+		std::vector<LoadedLibrary>& getLibraries();
+		DynamicLibrary* find( const char* name );
+		double getMilliseconds();
+
+	private:
+		std::vector<LoadedLibrary> libraries;
+		std::string status = "";
+		double milliseconds = 0;
+
+		template<typename F>
+		static void parallel( size_t count, unsigned threads, F task );
+
+		void order();
+
+};
+
+template<typename F> void LibraryLoader::parallel( size_t count, unsigned threads, F task ) {
+	std::atomic<size_t> next {0};
+	std::vector<std::thread> workers;
+
+	auto work = [&] () {
+		for( size_t i; (i = next.fetch_add( 1 )) < count; ) task( i );
+	};
+
+	threads = (unsigned) std::min<size_t>( threads, count );
+	for( unsigned i = 1; i < threads; i ++ ) workers.emplace_back( work );
+
+	work();
+	for( std::thread& worker : workers ) worker.join();
+}
+
 #endif
 
+#if defined(LIBLOAD_SANDBOX) && defined(LIBLOAD_LINUX)
+
+static_assert( (LIBLOAD_SANDBOX_SLOTS & (LIBLOAD_SANDBOX_SLOTS - 1)) == 0, "LIBLOAD_SANDBOX_SLOTS needs to be a power of two" );
+
+typedef void (*__LibloadInvoker) ( void* function, char* payload );
+
+struct __LibloadSandboxSlot {
+	std::atomic<uint32_t> turn;
+	std::atomic<uint32_t> queued;
+	std::atomic<uint32_t> state;
+	std::atomic<uint32_t> waiting;
+	uint32_t symbol;
+	__LibloadInvoker invoker;
+	alignas(16) char payload[LIBLOAD_SANDBOX_PAYLOAD];
+};
+
+// lives in memory shared with the host processes
+struct __LibloadSandbox {
+	std::atomic<uint32_t> status;
+	std::atomic<uint32_t> running;
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	std::atomic<uint32_t> bell;
+	std::atomic<uint32_t> sleeping;
+	std::atomic<uint32_t> restarts;
+	std::atomic<uint32_t> symbols;
+	char names[LIBLOAD_SANDBOX_SYMBOLS][LIBLOAD_SANDBOX_NAME];
+	char error[256];
+	__LibloadSandboxSlot slots[LIBLOAD_SANDBOX_SLOTS];
+};
+
+template<size_t... I>
+struct __LibloadIndices {};
+
+template<size_t N, size_t... I>
+struct __LibloadBuild : __LibloadBuild<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct __LibloadBuild<0, I...> {
+	typedef __LibloadIndices<I...> type;
+};
+
+template<typename R>
+struct __LibloadApply {
+	template<typename... A, size_t... I>
+	static void call( void* function, char* payload, __LibloadIndices<I...> ) {
+		std::tuple<A...>& args = *reinterpret_cast<std::tuple<A...>*>( payload );
+		R result = reinterpret_cast<R(*)(A...)>( function )( std::get<I>( args )... );
+		new (payload) R( result );
 	}
 
-	return reinterpret_cast<T>(0);
-}
+	static R take( __LibloadSandboxSlot* slot, bool success ) {
+		return success ? *reinterpret_cast<R*>( slot->payload ) : R();
+	}
+};
+
+template<>
+struct __LibloadApply<void> {
+	template<typename... A, size_t... I>
+	static void call( void* function, char* payload, __LibloadIndices<I...> ) {
+		std::tuple<A...>& args = *reinterpret_cast<std::tuple<A...>*>( payload );
+		reinterpret_cast<void(*)(A...)>( function )( std::get<I>( args )... );
+	}
+
+	static void take( __LibloadSandboxSlot*, bool ) {}
+};
+
+template<typename T>
+class SandboxedSymbol;
+
+class SandboxedLibrary {
+
+	public:
+		enum CallStatus {
+			CALL_OK,
+			CALL_CRASHED,
+			CALL_MISSING,
+			CALL_UNAVAILABLE
+		};
+
+		SandboxedLibrary( const char* path, int flags = DynamicLibrary::LAZY );
+		SandboxedLibrary( const SandboxedLibrary& sandbox ) = delete;
+		~SandboxedLibrary();
+
+		bool isLoaded() const;
+		const char* getMessage() const;
+		unsigned getRestarts() const;
+
+		template<typename T>
+		SandboxedSymbol<T> fetch( const char* name );
+
+		static CallStatus getCallStatus();
+
+	private:
+		template<typename T>
+		friend class SandboxedSymbol;
+
+		__LibloadSandbox* shared;
+		pid_t supervisor;
+		std::mutex mutex;
+
+		uint32_t resolve( const char* name );
+		__LibloadSandboxSlot* acquire( uint32_t& ticket );
+		bool submit( __LibloadSandboxSlot* slot );
+		void release( __LibloadSandboxSlot* slot, uint32_t ticket );
+		bool alive();
+
+		static CallStatus& status();
+
+};
+
+template<typename R, typename... A>
+class SandboxedSymbol<R(*)(A...)> {
+
+	public:
+		SandboxedSymbol( SandboxedLibrary* sandbox, uint32_t symbol )
+		: sandbox( sandbox ), symbol( symbol ) {}
+
+		R operator()( A... args ) const {
+			__LibloadSandboxSlot* slot;
+			uint32_t ticket;
+
+			if( this->symbol == UINT32_MAX ) {
+				SandboxedLibrary::status() = SandboxedLibrary::CALL_MISSING;
+				return __LibloadApply<R>::take( nullptr, false );
+			}
+
+			slot = this->sandbox->acquire( ticket );
+			new (slot->payload) std::tuple<A...>( args... );
+			slot->symbol = this->symbol;
+			slot->invoker = &invoke;
+
+			bool success = this->sandbox->submit( slot );
+			struct Release {
+				SandboxedLibrary* sandbox; __LibloadSandboxSlot* slot; uint32_t ticket;
+				~Release() { this->sandbox->release( this->slot, this->ticket ); }
+			} release { this->sandbox, slot, ticket };
+
+			return __LibloadApply<R>::take( slot, success );
+		}
+
+		explicit operator bool() const {
+			return this->symbol != UINT32_MAX;
+		}
+
+	private:
+		static_assert( sizeof(std::tuple<A...>) <= LIBLOAD_SANDBOX_PAYLOAD, "arguments don't fit into LIBLOAD_SANDBOX_PAYLOAD" );
+		static_assert( sizeof(typename std::conditional<std::is_void<R>::value, char, R>::type) <= LIBLOAD_SANDBOX_PAYLOAD, "result doesn't fit into LIBLOAD_SANDBOX_PAYLOAD" );
+		static_assert( std::is_void<R>::value || std::is_trivially_copyable<typename std::conditional<std::is_void<R>::value, char, R>::type>::value, "result needs to be trivially copyable" );
+		static_assert( std::is_same<std::tuple<typename std::enable_if<std::is_trivially_copyable<A>::value, A>::type...>, std::tuple<A...>>::value, "arguments need to be trivially copyable" );
+
+		// runs in the host process, the address is the same there as it was forked from us
+		static void invoke( void* function, char* payload ) {
+			__LibloadApply<R>::template call<A...>( function, payload, typename __LibloadBuild<sizeof...(A)>::type() );
+		}
+
+		SandboxedLibrary* sandbox;
+		uint32_t symbol;
+
+};
+
+template <typename T> SandboxedSymbol<T> SandboxedLibrary::fetch( const char* name ) {
+	return SandboxedSymbol<T>( this, this->resolve( name ) );
+}
+
+#endif
+
+// templates need to be visible in every translation unit
+template <typename T> T DynamicLibrary::fetch( const char* name ) const {
+	return reinterpret_cast<T>( this->address( name ) );
+}
+
+#ifdef LIBLOAD_PROFILE
+template <typename T> ProfiledSymbol<T> DynamicLibrary::fetchProfiled( const char* name ) const {
+	T function = this->fetch<T>( name );
+	return ProfiledSymbol<T>( function, function ? __LibloadProfile::get( this->location(), name ) : nullptr );
+}
+#else
+template <typename T> T DynamicLibrary::fetchProfiled( const char* name ) const {
+	return this->fetch<T>( name );
+}
+#endif
+
+template <typename T> SymbolBinder& SymbolBinder::bind( T& slot, const char* name ) {
+	slot = this->library.fetch<T>( name );
+	if( !slot ) this->missing.push_back( name );
+
+	return *this;
+}
+
+#if defined(LIBLOAD_HOT_RELOAD) && defined(LIBLOAD_LINUX)
+
+template<typename T> ReloadableLibrary<T>::Guard::Guard( const T* table, unsigned slot )
+: table( table ), slot( slot ) {}
+
+template<typename T> ReloadableLibrary<T>::Guard::Guard( Guard&& guard )
+: table( guard.table ), slot( guard.slot ) {
+	guard.slot = (unsigned) -1;
+}
+
+template<typename T> ReloadableLibrary<T>::Guard::~Guard() {
+	if( this->slot != (unsigned) -1 ) __LibloadEpoch::exit( this->slot );
+}
+
+template<typename T> const T* ReloadableLibrary<T>::Guard::operator->() const {
+	return this->table;
+}
+
+template<typename T> const T& ReloadableLibrary<T>::Guard::operator*() const {
+	return *this->table;
+}
+
+template<typename T> ReloadableLibrary<T>::Guard::operator bool() const {
+	return this->table != nullptr;
+}
+
+template<typename T> ReloadableLibrary<T>::ReloadableLibrary( const char* path, Binding binding, int flags )
+: path( path ), binding( binding ), flags( flags ), current( nullptr ), running( false ), generation( 0 ) {
+	this->reload();
+}
+
+template<typename T> ReloadableLibrary<T>::~ReloadableLibrary() {
+	if( this->running.exchange( false ) ) {
+		this->watcher.join();
+	}
+
+	std::lock_guard<std::mutex> lock( this->mutex );
+	Version* last = this->current.exchange( nullptr );
+
+	if( last ) {
+		last->retired = __LibloadEpoch::advance();
+		this->retired.push_back( last );
+	}
+
+	// a guard held by this thread would never go away, the versions are leaked
+	// (and stay loaded) instead of waiting forever
+	if( __LibloadEpoch::reading() ) {
+		assert( false && "ReloadableLibrary destroyed on a thread that holds a Guard" );
+		return;
+	}
+
+	// wait for the remaining readers
+	while( !this->retired.empty() ) {
+		this->reclaim();
+		if( !this->retired.empty() ) std::this_thread::yield();
+	}
+}
+
+template<typename T> typename ReloadableLibrary<T>::Guard ReloadableLibrary<T>::acquire() {
+	unsigned slot = __LibloadEpoch::enter();
+	Version* version = this->current.load( std::memory_order_seq_cst );
+
+	return Guard( version ? &version->table : nullptr, slot );
+}
+
+template<typename T> bool ReloadableLibrary<T>::isLoaded() {
+	return this->current.load() != nullptr;
+}
+
+template<typename T> unsigned ReloadableLibrary<T>::getGeneration() {
+	return this->generation.load();
+}
+
+template<typename T> std::string ReloadableLibrary<T>::getMessage() {
+	std::lock_guard<std::mutex> lock( this->mutex );
+	return this->status;
+}
+
+template<typename T> int ReloadableLibrary<T>::copy( std::string& temp ) {
+	int in = open( this->path.c_str(), O_RDONLY | O_CLOEXEC );
+	int out = -1;
+
+	if( in < 0 ) return -1;
+
+	// anonymous memory file, doesn't depend on /tmp being mounted with exec permission
+#ifdef MFD_CLOEXEC
+	out = memfd_create( "libload", MFD_CLOEXEC );
+	if( out >= 0 ) temp = "/proc/self/fd/" + std::to_string( out );
+#endif
+
+	// otherwise next to the original, that directory is known to allow loading libraries
+	if( out < 0 ) {
+		temp = this->path + ".libload-XXXXXX";
+		out = mkostemp( &temp[0], O_CLOEXEC );
+	}
+
+	char buffer[65536];
+	ssize_t count = 0;
+
+	while( out >= 0 ) {
+		count = read( in, buffer, sizeof(buffer) );
+		if( count < 0 && errno == EINTR ) continue;
+		if( count <= 0 ) break;
+
+		for( ssize_t done = 0, written; done < count; done += written ) {
+			written = write( out, buffer + done, count - done );
+
+			if( written < 0 && errno == EINTR ) {
+				written = 0;
+			}else if( written <= 0 ) {
+				count = -1;
+				break;
+			}
+		}
+
+		if( count < 0 ) break;
+	}
+
+	::close( in );
+
+	if( count < 0 && out >= 0 ) {
+		::close( out );
+		out = -1;
+	}
+
+	return out;
+}
+
+template<typename T> typename ReloadableLibrary<T>::Version* ReloadableLibrary<T>::load() {
+
+	// dlopen() returns the already loaded object for the same path or inode,
+	// so every version is loaded from its own private copy of the file
+	std::string temp;
+	int fd = this->copy( temp );
+	bool memfd = temp.compare( 0, 14, "/proc/self/fd/" ) == 0;
+
+	if( fd < 0 ) {
+		if( !memfd && !temp.empty() ) unlink( temp.c_str() );
+		this->status = "unable to copy library";
+		return nullptr;
+	}
+
+	Version* version = new Version( temp.c_str(), this->flags, memfd ? fd : -1 );
+
+	if( !memfd ) {
+		::close( fd );
+		unlink( temp.c_str() );
+	}
+
+	if( !version->library.isLoaded() ) {
+		this->status = DynamicLibrary::getError();
+		delete version;
+		return nullptr;
+	}
+
+	if( !this->binding( version->library, version->table ) ) {
+		this->status = "binding failed";
+		delete version;
+		return nullptr;
+	}
+
+	this->status = "";
+	return version;
+}
+
+template<typename T> bool ReloadableLibrary<T>::reload() {
+	std::lock_guard<std::mutex> lock( this->mutex );
+	Version* version = this->load();
+
+	// keep the old version running if the new one is broken
+	if( !version ) return false;
+
+	Version* old = this->current.exchange( version, std::memory_order_seq_cst );
+	this->generation ++;
+
+	if( old ) {
+		old->retired = __LibloadEpoch::advance();
+		this->retired.push_back( old );
+	}
+
+	this->reclaim();
+	return true;
+}
+
+template<typename T> void ReloadableLibrary<T>::reclaim() {
+	for( size_t i = 0; i < this->retired.size(); ) {
+		if( __LibloadEpoch::quiescent( this->retired[i]->retired ) ) {
+			delete this->retired[i];
+			this->retired[i] = this->retired.back();
+			this->retired.pop_back();
+		}else{
+			i ++;
+		}
+	}
+}
+
+template<typename T> void ReloadableLibrary<T>::watch() {
+	if( !this->running.exchange( true ) ) {
+		this->watcher = std::thread( &ReloadableLibrary<T>::run, this );
+	}
+}
+
+template<typename T> void ReloadableLibrary<T>::run() {
+	size_t split = this->path.find_last_of( '/' );
+	std::string directory = split == std::string::npos ? "." : this->path.substr( 0, split + 1 );
+	std::string name = split == std::string::npos ? this->path : this->path.substr( split + 1 );
+
+	// watch the directory, libraries are usually replaced by rename()
+	int fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( fd < 0 || inotify_add_watch( fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0 ) {
+		std::lock_guard<std::mutex> lock( this->mutex );
+		this->status = "unable to watch library";
+		if( fd >= 0 ) ::close( fd );
+		return;
+	}
+
+	alignas(struct inotify_event) char buffer[4096];
+	pollfd entry { fd, POLLIN, 0 };
+
+	while( this->running.load() ) {
+		bool changed = false;
+
+		if( poll( &entry, 1, 100 ) > 0 ) {
+			ssize_t length;
+
+			while( (length = read( fd, buffer, sizeof(buffer) )) > 0 ) {
+				for( char* p = buffer; p < buffer + length; ) {
+					inotify_event* event = reinterpret_cast<inotify_event*>( p );
+					if( event->len && name == event->name && !(event->mask & IN_CREATE) ) changed = true;
+					p += sizeof(inotify_event) + event->len;
+				}
+			}
+		}
+
+		if( changed ) {
+			this->reload();
+		}else{
+			std::lock_guard<std::mutex> lock( this->mutex );
+			this->reclaim();
+		}
+	}
+
+	::close( fd );
+}
+
+#endif
+
+#ifdef LIBLOAD_IMPLEMENT
+
+// dlerror() messages are only valid until the next loader call,
+// so the message of a failed load is copied out right away
+static thread_local char __libload_error[256] = "";
+
+static void __libload_fail( const char* message ) {
+	strncpy( __libload_error, message ? message : "unknown error", sizeof(__libload_error) - 1 );
+}
+
+DynamicLibrary::DynamicLibrary( const char* path, int flags ) {
+	__DynLibData handle;
+
+#ifdef LIBLOAD_WINDOWS
+	handle.handle = LoadLibrary( TEXT(path) );
+	if( !handle.handle ) __libload_fail( "null handle" );
+#endif
+
+#ifdef LIBLOAD_LINUX
+	int mode = (flags & NOW) ? RTLD_NOW : RTLD_LAZY;
+	if( flags & GLOBAL ) mode |= RTLD_GLOBAL;
+	if( flags & NODELETE ) mode |= RTLD_NODELETE;
+	if( flags & DEEPBIND ) mode |= RTLD_DEEPBIND;
+
+	handle.handle = dlopen(path, mode);
+	if( !handle.handle ) __libload_fail( dlerror() );
+#endif
+
+	if( handle.handle ) {
+		this->data = new __DynLibData { handle.handle, {1} };
+		this->state = LOADED;
+
+		if( flags & PREFAULT ) this->prefault();
+	}
+}
+
+DynamicLibrary::DynamicLibrary( const DynamicLibrary& dl )
+: data( dl.data ), state( dl.state ) {
+	if( this->data ) this->data->references.fetch_add( 1, std::memory_order_relaxed );
+}
+
+DynamicLibrary::DynamicLibrary( DynamicLibrary&& dl )
+: data( dl.data ), state( dl.state ) {
+	dl.data = nullptr;
+	dl.state = MOVED;
+}
+
+DynamicLibrary::~DynamicLibrary() {
+	this->close();
+}
+
+DynamicLibrary& DynamicLibrary::operator=( const DynamicLibrary& dl ) {
+	if( this->data != dl.data ) {
+		this->close();
+		this->data = dl.data;
+		if( this->data ) this->data->references.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	this->state = dl.state;
+	return *this;
+}
+
+DynamicLibrary& DynamicLibrary::operator=( DynamicLibrary&& dl ) {
+	if( this != &dl ) {
+		this->close();
+		this->data = dl.data;
+		this->state = dl.state;
+		dl.data = nullptr;
+		dl.state = MOVED;
+	}
+
+	return *this;
+}
+
+const char* DynamicLibrary::getMessage() const {
+	switch( this->state ) {
+		case LOADED: return "";
+		case FAILED: return "library loading failed";
+		case CLOSED: return "library unloaded";
+		case MOVED: return "library ownership moved";
+	}
+
+	return "";
+}
+
+const char* DynamicLibrary::getError() {
+	return __libload_error;
+}
+
+bool DynamicLibrary::isLoaded() const {
+	return this->state == LOADED;
+}
+
+DynamicLibrary::State DynamicLibrary::getState() const {
+	return this->state;
+}
+
+unsigned DynamicLibrary::getReferences() const {
+	return this->data ? this->data->references.load( std::memory_order_relaxed ) : 0;
+}
+
+void DynamicLibrary::close() {
+	if( this->isLoaded() ) {
+		this->state = CLOSED;
+
+		// last reference closes the library
+		if( this->data->references.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+
+#ifdef LIBLOAD_WINDOWS
+			FreeLibrary( this->data->handle );
+#endif
+
+#ifdef LIBLOAD_LINUX
+			dlclose(this->data->handle);
+#endif
+
+			delete this->data;
+		}
+
+		this->data = nullptr;
+	}
+}
+
+void* DynamicLibrary::address( const char* name ) const {
+	if( this->isLoaded() ) {
+
+#ifdef LIBLOAD_WINDOWS
+		return reinterpret_cast<void*>( GetProcAddress( this->data->handle, name ) );
+#endif
+
+#ifdef LIBLOAD_LINUX
+		return dlsym( this->data->handle, name );
+#endif
+
+	}
+
+	return nullptr;
+}
+
+#ifdef LIBLOAD_LINUX
+
+struct __LibloadSegments {
+	ElfW(Addr) base;
+	const char* name;
+};
+
+static int __libload_prefault( struct dl_phdr_info* info, size_t, void* data ) {
+	__LibloadSegments* target = (__LibloadSegments*) data;
+
+	if( info->dlpi_addr != target->base || strcmp( info->dlpi_name, target->name ) != 0 ) {
+		return 0;
+	}
+
+	const uintptr_t page = sysconf( _SC_PAGESIZE );
+
+	for( int i = 0; i < info->dlpi_phnum; i ++ ) {
+		const ElfW(Phdr)& header = info->dlpi_phdr[i];
+
+		if( header.p_type == PT_LOAD && (header.p_flags & PF_X) ) {
+			uintptr_t start = (info->dlpi_addr + header.p_vaddr) & ~(page - 1);
+			uintptr_t end = info->dlpi_addr + header.p_vaddr + header.p_memsz;
+
+			// start the read ahead for the whole segment, then
+			// touch every page so that it is also mapped into this process
+			madvise( (void*) start, end - start, MADV_WILLNEED );
+
+			for( uintptr_t address = start; address < end; address += page ) {
+				(void) *(volatile const char*) address;
+			}
+		}
+	}
+
+	return 1;
+}
+
+#endif
+
+void DynamicLibrary::prefault() {
+
+#ifdef LIBLOAD_LINUX
+	struct link_map* map = nullptr;
+
+	if( dlinfo( this->data->handle, RTLD_DI_LINKMAP, &map ) == 0 && map ) {
+		__LibloadSegments target { map->l_addr, map->l_name };
+		dl_iterate_phdr( __libload_prefault, &target );
+	}
+#endif
+
+}
+
+SymbolBinder::SymbolBinder( DynamicLibrary& dl )
+: library( dl ) {}
+
+bool SymbolBinder::isComplete() {
+	return this->missing.empty();
+}
+
+const std::vector<const char*>& SymbolBinder::getMissing() {
+	return this->missing;
+}
+
+#ifdef LIBLOAD_LINUX
+
+LibraryInfo::LibraryInfo( const char* path, bool prefetch ) {
+	int fd = open( path, O_RDONLY | O_CLOEXEC );
+	struct stat info;
+
+	if( fd < 0 || fstat( fd, &info ) != 0 ) {
+		this->status = "unable to open file";
+		if( fd >= 0 ) ::close( fd );
+		return;
+	}
+
+	if( (size_t) info.st_size < sizeof(ElfW(Ehdr)) ) {
+		this->status = "not an ELF file";
+		::close( fd );
+		return;
+	}
+
+	this->size = info.st_size;
+	void* map = mmap( nullptr, this->size, PROT_READ, MAP_PRIVATE | (prefetch ? MAP_POPULATE : 0), fd, 0 );
+	::close( fd );
+
+	if( map == MAP_FAILED ) {
+		this->status = "unable to map file";
+		return;
+	}
+
+	this->base = (const char*) map;
+	this->status = this->parse();
+}
+
+LibraryInfo::LibraryInfo( LibraryInfo&& info )
+: base( info.base ), size( info.size ), status( info.status ), soname( info.soname ), needed( std::move( info.needed ) ), symbols( std::move( info.symbols ) ) {
+	info.base = nullptr;
+	info.status = "library info moved";
+}
+
+LibraryInfo::~LibraryInfo() {
+	if( this->base ) munmap( (void*) this->base, this->size );
+}
+
+bool LibraryInfo::isValid() const {
+	return this->status[0] == 0;
+}
+
+const char* LibraryInfo::getMessage() const {
+	return this->status;
+}
+
+const char* LibraryInfo::getSoname() const {
+	return this->soname;
+}
+
+const std::vector<const char*>& LibraryInfo::getNeeded() const {
+	return this->needed;
+}
+
+const std::vector<LibrarySymbol>& LibraryInfo::getSymbols() const {
+	return this->symbols;
+}
+
+std::vector<const LibrarySymbol*> LibraryInfo::find( const char* prefix ) const {
+	std::vector<const LibrarySymbol*> matches;
+	const size_t length = strlen( prefix );
+
+	for( const LibrarySymbol& symbol : this->symbols ) {
+		if( strncmp( symbol.name, prefix, length ) == 0 ) matches.push_back( &symbol );
+	}
+
+	return matches;
+}
+
+// maps a virtual address to the file, the whole range needs to be inside one segment
+const char* LibraryInfo::address( ElfW(Addr) address, size_t length ) const {
+	const ElfW(Ehdr)* header = (const ElfW(Ehdr)*) this->base;
+	const ElfW(Phdr)* segments = (const ElfW(Phdr)*) (this->base + header->e_phoff);
+
+	for( int i = 0; i < header->e_phnum; i ++ ) {
+		const ElfW(Phdr)& segment = segments[i];
+
+		if( segment.p_type == PT_LOAD && address >= segment.p_vaddr && length <= segment.p_filesz && address - segment.p_vaddr <= segment.p_filesz - length ) {
+			size_t offset = segment.p_offset + (address - segment.p_vaddr);
+			return offset <= this->size && length <= this->size - offset ? this->base + offset : nullptr;
+		}
+	}
+
+	return nullptr;
+}
+
+const char* LibraryInfo::parse() {
+	const ElfW(Ehdr)* header = (const ElfW(Ehdr)*) this->base;
+
+	if( memcmp( header->e_ident, ELFMAG, SELFMAG ) != 0 ) return "not an ELF file";
+	if( header->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ) return "wrong ELF class";
+	if( header->e_ident[EI_DATA] != __LIBLOAD_ELF_DATA ) return "wrong ELF byte order";
+#ifdef __LIBLOAD_ELF_MACHINE
+	if( header->e_machine != __LIBLOAD_ELF_MACHINE ) return "wrong ELF machine";
+#endif
+	if( header->e_phoff > this->size || header->e_phnum * sizeof(ElfW(Phdr)) > this->size - header->e_phoff ) return "invalid program headers";
+
+	const ElfW(Phdr)* segments = (const ElfW(Phdr)*) (this->base + header->e_phoff);
+	const ElfW(Dyn)* dynamic = nullptr;
+	size_t entries = 0;
+
+	for( int i = 0; i < header->e_phnum; i ++ ) {
+		if( segments[i].p_type == PT_DYNAMIC && segments[i].p_offset <= this->size && segments[i].p_filesz <= this->size - segments[i].p_offset ) {
+			dynamic = (const ElfW(Dyn)*) (this->base + segments[i].p_offset);
+			entries = segments[i].p_filesz / sizeof(ElfW(Dyn));
+		}
+	}
+
+	if( !dynamic ) return "no dynamic section";
+
+	ElfW(Addr) strtab = 0, symtab = 0, hash = 0, gnuhash = 0, versym = 0, verdef = 0;
+	size_t strsz = 0, verdefnum = 0;
+
+	for( size_t i = 0; i < entries && dynamic[i].d_tag != DT_NULL; i ++ ) {
+		switch( dynamic[i].d_tag ) {
+			case DT_STRTAB: strtab = dynamic[i].d_un.d_ptr; break;
+			case DT_STRSZ: strsz = dynamic[i].d_un.d_val; break;
+			case DT_SYMTAB: symtab = dynamic[i].d_un.d_ptr; break;
+			case DT_HASH: hash = dynamic[i].d_un.d_ptr; break;
+			case DT_GNU_HASH: gnuhash = dynamic[i].d_un.d_ptr; break;
+			case DT_VERSYM: versym = dynamic[i].d_un.d_ptr; break;
+			case DT_VERDEF: verdef = dynamic[i].d_un.d_ptr; break;
+			case DT_VERDEFNUM: verdefnum = dynamic[i].d_un.d_val; break;
+		}
+	}
+
+	// a terminated table means that every string inside of it is terminated too
+	const char* strings = strsz ? this->address( strtab, strsz ) : nullptr;
+	if( !strings || strings[strsz - 1] != 0 ) return "invalid string table";
+
+	for( size_t i = 0; i < entries && dynamic[i].d_tag != DT_NULL; i ++ ) {
+		if( dynamic[i].d_un.d_val >= strsz ) continue;
+		if( dynamic[i].d_tag == DT_NEEDED ) this->needed.push_back( strings + dynamic[i].d_un.d_val );
+		if( dynamic[i].d_tag == DT_SONAME ) this->soname = strings + dynamic[i].d_un.d_val;
+	}
+
+	// the symbol count isn't stored anywhere directly, it has to be taken from one of the hash tables
+	size_t count = 0;
+
+	if( gnuhash ) {
+		const uint32_t* table = (const uint32_t*) this->address( gnuhash, 4 * sizeof(uint32_t) );
+		if( !table ) return "invalid hash table";
+
+		const uint32_t buckets = table[0], offset = table[1], blooms = table[2];
+		const size_t skip = 4 * sizeof(uint32_t) + blooms * sizeof(ElfW(Addr));
+		const uint32_t* bucket = (const uint32_t*) this->address( gnuhash + skip, buckets * sizeof(uint32_t) );
+		if( !bucket ) return "invalid hash table";
+
+		uint32_t last = 0;
+		for( uint32_t i = 0; i < buckets; i ++ ) last = std::max( last, bucket[i] );
+
+		if( last < offset ) {
+			count = offset;
+		}else{
+			ElfW(Addr) chain = gnuhash + skip + buckets * sizeof(uint32_t) + (last - offset) * sizeof(uint32_t);
+
+			for( ;; last ++, chain += sizeof(uint32_t) ) {
+				const uint32_t* entry = (const uint32_t*) this->address( chain, sizeof(uint32_t) );
+				if( !entry ) return "invalid hash table";
+				if( *entry & 1 ) break;
+			}
+
+			count = last + 1;
+		}
+	}else if( hash ) {
+		const uint32_t* table = (const uint32_t*) this->address( hash, 2 * sizeof(uint32_t) );
+		if( !table ) return "invalid hash table";
+
+		count = table[1];
+	}
+
+	const ElfW(Sym)* table = count ? (const ElfW(Sym)*) this->address( symtab, count * sizeof(ElfW(Sym)) ) : nullptr;
+	if( count && !table ) return "invalid symbol table";
+
+	const uint16_t* versions = versym ? (const uint16_t*) this->address( versym, count * sizeof(uint16_t) ) : nullptr;
+	std::vector<const char*> names;
+
+	// version definitions form a linked list, index 1 is the library itself
+	for( size_t i = 0; verdef && i < verdefnum; i ++ ) {
+		const ElfW(Verdef)* definition = (const ElfW(Verdef)*) this->address( verdef, sizeof(ElfW(Verdef)) );
+		if( !definition ) break;
+
+		const ElfW(Verdaux)* aux = (const ElfW(Verdaux)*) this->address( verdef + definition->vd_aux, sizeof(ElfW(Verdaux)) );
+		if( aux && aux->vda_name < strsz && !(definition->vd_flags & VER_FLG_BASE) ) {
+			if( names.size() <= definition->vd_ndx ) names.resize( definition->vd_ndx + 1, nullptr );
+			names[definition->vd_ndx] = strings + aux->vda_name;
+		}
+
+		if( !definition->vd_next ) break;
+		verdef += definition->vd_next;
+	}
+
+	this->symbols.reserve( count );
+
+	for( size_t i = 1; i < count; i ++ ) {
+		const ElfW(Sym)& symbol = table[i];
+		const unsigned char bind = ELF64_ST_BIND( symbol.st_info );
+
+		// only what the library defines and exports
+		if( symbol.st_shndx == SHN_UNDEF || symbol.st_name >= strsz ) continue;
+		if( bind != STB_GLOBAL && bind != STB_WEAK && bind != STB_GNU_UNIQUE ) continue;
+		if( ELF64_ST_VISIBILITY( symbol.st_other ) != STV_DEFAULT && ELF64_ST_VISIBILITY( symbol.st_other ) != STV_PROTECTED ) continue;
+
+		uint16_t version = versions ? versions[i] : 0;
+		uint16_t index = version & 0x7fff;
+
+		LibrarySymbol entry;
+		entry.name = strings + symbol.st_name;
+		entry.version = index < names.size() ? names[index] : nullptr;
+		entry.value = symbol.st_value;
+		entry.size = symbol.st_size;
+		entry.type = ELF64_ST_TYPE( symbol.st_info );
+		entry.hidden = version & 0x8000;
+
+		this->symbols.push_back( entry );
+	}
+
+	return "";
+}
+
+// symbols whose address is the load base plus the symbol value
+static bool __libload_direct( const LibrarySymbol* symbol ) {
+	return symbol->type != STT_TLS && symbol->type != STT_GNU_IFUNC && !symbol->hidden;
+}
+
+std::vector<void*> DynamicLibrary::fetchAll( const std::vector<const LibrarySymbol*>& symbols ) const {
+	std::vector<void*> addresses( symbols.size(), nullptr );
+	if( !this->isLoaded() ) return addresses;
+
+	struct link_map* map = nullptr;
+	bool direct = dlinfo( this->data->handle, RTLD_DI_LINKMAP, &map ) == 0 && map;
+
+	// check that the loaded object is the file the symbols came from, using the first
+	// and the last symbol that can be computed directly, if there are none nothing is trusted
+	const LibrarySymbol* first = nullptr;
+	const LibrarySymbol* last = nullptr;
+
+	for( const LibrarySymbol* symbol : symbols ) {
+		if( __libload_direct( symbol ) ) {
+			if( !first ) first = symbol;
+			last = symbol;
+		}
+	}
+
+	if( direct && first ) {
+		direct = dlsym( this->data->handle, first->name ) == (void*) (map->l_addr + first->value)
+			&& (last == first || dlsym( this->data->handle, last->name ) == (void*) (map->l_addr + last->value));
+	}
+
+	for( size_t i = 0; i < symbols.size(); i ++ ) {
+		const LibrarySymbol* symbol = symbols[i];
+
+		// thread local, indirect and hidden symbols need the loader to compute the address
+		if( direct && __libload_direct( symbol ) ) {
+			addresses[i] = (void*) (map->l_addr + symbol->value);
+		}else{
+			addresses[i] = symbol->version ? dlvsym( this->data->handle, symbol->name, symbol->version ) : dlsym( this->data->handle, symbol->name );
+		}
+	}
+
+	return addresses;
+}
+
+#endif
+
+#ifdef LIBLOAD_PROFILE
+
+// profiles are never freed, wrappers can outlive the library they came from
+static std::mutex __libload_profile_lock;
+static std::vector<__LibloadProfile*> __libload_profiles;
+static uint64_t __libload_profile_tick;
+static std::chrono::steady_clock::time_point __libload_profile_time;
+
+// path of the loaded object, so that the same symbol in different libraries gets different profiles
+std::string DynamicLibrary::location() const {
+
+#ifdef LIBLOAD_WINDOWS
+	char path[MAX_PATH];
+	DWORD length = GetModuleFileNameA( this->data->handle, path, MAX_PATH );
+	return std::string( path, length );
+#endif
+
+#ifdef LIBLOAD_LINUX
+	struct link_map* map = nullptr;
+
+	if( dlinfo( this->data->handle, RTLD_DI_LINKMAP, &map ) == 0 && map && map->l_name ) {
+		return map->l_name;
+	}
+
+	return "";
+#endif
+
+}
+
+__LibloadProfile* __LibloadProfile::get( const std::string& library, const char* name ) {
+	std::lock_guard<std::mutex> lock( __libload_profile_lock );
+
+	for( __LibloadProfile* profile : __libload_profiles ) {
+		if( strcmp( profile->name, name ) == 0 && library == profile->library ) return profile;
+	}
+
+	if( __libload_profiles.empty() ) {
+		__libload_profile_tick = tick();
+		__libload_profile_time = std::chrono::steady_clock::now();
+	}
+
+	__LibloadProfile* profile = new __LibloadProfile();
+	char* copy = new char[library.size() + strlen( name ) + 2];
+	strcpy( copy, library.c_str() );
+	strcpy( copy + library.size() + 1, name );
+
+	profile->library = copy;
+	profile->name = copy + library.size() + 1;
+	__libload_profiles.push_back( profile );
+
+	return profile;
+}
+
+// finds the tick that falls into the given fraction of all calls and returns the middle of its bucket
+static double __libload_percentile( const uint64_t* buckets, uint64_t calls, double fraction ) {
+	uint64_t target = (uint64_t) (calls * fraction), seen = 0;
+
+	for( unsigned i = 0; i < __LIBLOAD_BUCKETS; i ++ ) {
+		seen += buckets[i];
+
+		if( seen > target ) {
+			if( i < 4 ) return i;
+
+			unsigned exponent = i / 4 + 1;
+			double low = (double) ((4ull + i % 4) << (exponent - 2));
+			return low + (double) (1ull << (exponent - 2)) / 2;
+		}
+	}
+
+	return 0;
+}
+
+std::vector<ProfileReport> LibraryProfiler::report() {
+	static std::chrono::steady_clock::time_point previous;
+	std::lock_guard<std::mutex> lock( __libload_profile_lock );
+	std::vector<ProfileReport> reports;
+
+	if( __libload_profiles.empty() ) return reports;
+
+	// calibrate ticks against the steady clock over the whole profiling run
+	auto now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double, std::nano>( now - __libload_profile_time ).count();
+	uint64_t ticks = __LibloadProfile::tick() - __libload_profile_tick;
+	double scale = ticks ? elapsed / ticks : 1;
+
+	if( previous < __libload_profile_time ) previous = __libload_profile_time;
+	double seconds = std::chrono::duration<double>( now - previous ).count();
+	previous = now;
+
+	for( __LibloadProfile* profile : __libload_profiles ) {
+		uint64_t buckets[__LIBLOAD_BUCKETS] = {0};
+		uint64_t calls = 0;
+
+		for( unsigned i = 0; i < __LIBLOAD_BUCKETS; i ++ ) {
+			uint64_t total = 0;
+
+			for( __LibloadShard& shard : profile->shards ) {
+				total += shard.buckets[i].load( std::memory_order_relaxed );
+			}
+
+			buckets[i] = total - profile->snapshot[i];
+			profile->snapshot[i] = total;
+			calls += buckets[i];
+		}
+
+		ProfileReport report;
+		report.library = profile->library;
+		report.name = profile->name;
+		report.calls = calls;
+		report.rate = seconds > 0 ? calls / seconds : 0;
+		report.p50 = __libload_percentile( buckets, calls, 0.50 ) * scale;
+		report.p99 = __libload_percentile( buckets, calls, 0.99 ) * scale;
+
+		reports.push_back( report );
+	}
+
+	return reports;
+}
+
+void LibraryProfiler::dump( FILE* out ) {
+	std::vector<ProfileReport> reports = report();
+
+	fprintf( out, "%-20s %-20s %12s %12s %12s %12s\n", "library", "symbol", "calls", "calls/s", "p50", "p99" );
+	for( ProfileReport& report : reports ) {
+		const char* library = strrchr( report.library, '/' );
+
+#ifdef LIBLOAD_WINDOWS
+		const char* separator = strrchr( report.library, '\\' );
+		if( separator && (!library || separator > library) ) library = separator;
+#endif
+
+		library = library ? library + 1 : report.library;
+		fprintf( out, "%-20s %-20s %12llu %12.1f %10.3fus %10.3fus\n", library, report.name, (unsigned long long) report.calls, report.rate, report.p50 / 1000, report.p99 / 1000 );
+	}
+
+	fflush( out );
+}
+
+#endif
+
+#if defined(LIBLOAD_SANDBOX) && defined(LIBLOAD_LINUX)
+
+#define __LIBLOAD_STARTING 0
+#define __LIBLOAD_READY 1
+#define __LIBLOAD_FAILED 2
+
+#define __LIBLOAD_IDLE 0
+#define __LIBLOAD_REQUEST 1
+#define __LIBLOAD_RUNNING 2
+#define __LIBLOAD_DONE 3
+#define __LIBLOAD_MISSING 4
+#define __LIBLOAD_CRASHED 5
+
+// host exit code used when the library can't be loaded at all
+#define __LIBLOAD_UNLOADABLE 125
+
+// spinning only helps if the other side runs on a different core
+static const int __libload_spin = sysconf( _SC_NPROCESSORS_ONLN ) > 1 ? 4096 : 0;
+
+// the mapping is shared between processes so the futexes can't be private
+static void __libload_wait( std::atomic<uint32_t>& word, uint32_t value, const timespec* timeout = nullptr ) {
+	syscall( SYS_futex, (uint32_t*) &word, FUTEX_WAIT, value, timeout, nullptr, 0 );
+}
+
+static void __libload_wake( std::atomic<uint32_t>& word ) {
+	syscall( SYS_futex, (uint32_t*) &word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0 );
+}
+
+static void __libload_finish( __LibloadSandboxSlot& slot, uint32_t state ) {
+	slot.state.store( state );
+	if( slot.waiting.load() ) __libload_wake( slot.state );
+}
+
+static void __libload_host( __LibloadSandbox* shared, const char* path, int flags ) {
+	DynamicLibrary library( path, flags );
+
+	if( !library.isLoaded() ) {
+		snprintf( shared->error, sizeof(shared->error), "%s", DynamicLibrary::getError() );
+		_exit( __LIBLOAD_UNLOADABLE );
+	}
+
+	shared->status.store( __LIBLOAD_READY );
+	__libload_wake( shared->status );
+
+	void* symbols[LIBLOAD_SANDBOX_SYMBOLS] = {};
+	uint32_t tail = shared->tail.load();
+
+	while( true ) {
+		__LibloadSandboxSlot& slot = shared->slots[tail % LIBLOAD_SANDBOX_SLOTS];
+
+		// spin for a while before going to sleep, that keeps back to back calls cheap
+		for( int i = 0; slot.state.load() != __LIBLOAD_REQUEST; i ++ ) {
+			if( !shared->running.load() ) return;
+			if( i < __libload_spin ) continue;
+
+			shared->sleeping.store( 1 );
+			uint32_t bell = shared->bell.load();
+
+			if( slot.state.load() != __LIBLOAD_REQUEST && shared->running.load() ) {
+				__libload_wait( shared->bell, bell );
+			}
+
+			shared->sleeping.store( 0 );
+		}
+
+		slot.state.store( __LIBLOAD_RUNNING );
+
+		uint32_t symbol = slot.symbol;
+		if( !symbols[symbol] ) symbols[symbol] = library.fetch<void*>( shared->names[symbol] );
+		if( symbols[symbol] && slot.invoker ) slot.invoker( symbols[symbol], slot.payload );
+
+		shared->tail.store( ++ tail );
+		__libload_finish( slot, symbols[symbol] ? __LIBLOAD_DONE : __LIBLOAD_MISSING );
+	}
+}
+
+// fails the call that was running when the host died, calls that
+// were only waiting stay in the ring and are picked up by the next host
+static void __libload_recover( __LibloadSandbox* shared ) {
+	uint32_t tail = shared->tail.load();
+
+	for( __LibloadSandboxSlot& slot : shared->slots ) {
+		uint32_t expected = __LIBLOAD_RUNNING;
+
+		if( slot.state.compare_exchange_strong( expected, __LIBLOAD_CRASHED ) ) {
+			__libload_wake( slot.state );
+
+			// host died before moving past this slot
+			if( &slot == &shared->slots[tail % LIBLOAD_SANDBOX_SLOTS] ) shared->tail.store( tail + 1 );
+		}
+	}
+}
+
+// nobody will ever answer the pending calls, fail them all
+static void __libload_abandon( __LibloadSandbox* shared ) {
+	shared->status.store( __LIBLOAD_FAILED );
+	__libload_wake( shared->status );
+
+	for( __LibloadSandboxSlot& slot : shared->slots ) {
+		uint32_t state = slot.state.load();
+
+		while( (state == __LIBLOAD_REQUEST || state == __LIBLOAD_RUNNING) && !slot.state.compare_exchange_weak( state, __LIBLOAD_CRASHED ) );
+		__libload_wake( slot.state );
+	}
+}
+
+static void __libload_supervise( __LibloadSandbox* shared, const char* path, int flags ) {
+	while( shared->running.load() ) {
+		pid_t host = fork();
+
+		if( host == 0 ) {
+			prctl( PR_SET_PDEATHSIG, SIGKILL );
+			__libload_host( shared, path, flags );
+			_exit( 0 );
+		}
+
+		int status = 0;
+		while( host > 0 && waitpid( host, &status, 0 ) < 0 && errno == EINTR );
+
+		if( !shared->running.load() ) break;
+
+		if( host < 0 || (WIFEXITED( status ) && WEXITSTATUS( status ) == __LIBLOAD_UNLOADABLE) ) {
+			if( host < 0 ) snprintf( shared->error, sizeof(shared->error), "unable to start host process" );
+
+			__libload_abandon( shared );
+			break;
+		}
+
+		shared->restarts.fetch_add( 1 );
+		__libload_recover( shared );
+	}
+}
+
+SandboxedLibrary::SandboxedLibrary( const char* path, int flags ) {
+	void* memory = mmap( nullptr, sizeof(__LibloadSandbox), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	this->supervisor = -1;
+
+	if( memory == MAP_FAILED ) {
+		this->shared = nullptr;
+		return;
+	}
+
+	this->shared = new (memory) __LibloadSandbox();
+	this->shared->running.store( 1 );
+
+	for( uint32_t i = 0; i < LIBLOAD_SANDBOX_SLOTS; i ++ ) {
+		this->shared->slots[i].turn.store( i );
+	}
+
+	// the supervisor stays single threaded, so it can safely fork new hosts after a crash
+	pid_t parent = getpid();
+	this->supervisor = fork();
+
+	if( this->supervisor == 0 ) {
+		prctl( PR_SET_PDEATHSIG, SIGKILL );
+		if( getppid() == parent ) __libload_supervise( this->shared, path, flags );
+		_exit( 0 );
+	}
+
+	if( this->supervisor < 0 ) {
+		snprintf( this->shared->error, sizeof(this->shared->error), "unable to start supervisor process" );
+		this->shared->status.store( __LIBLOAD_FAILED );
+		return;
+	}
+
+	uint32_t status;
+	while( (status = this->shared->status.load()) == __LIBLOAD_STARTING ) {
+		__libload_wait( this->shared->status, status );
+	}
+}
+
+SandboxedLibrary::~SandboxedLibrary() {
+	if( this->shared ) {
+		this->shared->running.store( 0 );
+		this->shared->bell.fetch_add( 1 );
+		__libload_wake( this->shared->bell );
+
+		if( this->supervisor > 0 ) {
+			pid_t result = 0;
+
+			// a plugin call that never returns would keep the host (and so the supervisor) alive,
+			// the host gets SIGKILL from its parent death signal once the supervisor is gone
+			for( int i = 0; i < LIBLOAD_SANDBOX_SHUTDOWN && result == 0; i ++ ) {
+				result = waitpid( this->supervisor, nullptr, WNOHANG );
+				if( result == 0 ) usleep( 1000 );
+			}
+
+			if( result == 0 ) {
+				kill( this->supervisor, SIGKILL );
+				while( waitpid( this->supervisor, nullptr, 0 ) < 0 && errno == EINTR );
+			}
+		}
+
+		munmap( this->shared, sizeof(__LibloadSandbox) );
+	}
+}
+
+bool SandboxedLibrary::isLoaded() const {
+	return this->shared && this->shared->status.load() == __LIBLOAD_READY;
+}
+
+const char* SandboxedLibrary::getMessage() const {
+	if( !this->shared ) return "unable to map shared memory";
+	return this->isLoaded() ? "" : this->shared->error;
+}
+
+unsigned SandboxedLibrary::getRestarts() const {
+	return this->shared ? this->shared->restarts.load() : 0;
+}
+
+SandboxedLibrary::CallStatus& SandboxedLibrary::status() {
+	static thread_local CallStatus status = CALL_OK;
+	return status;
+}
+
+SandboxedLibrary::CallStatus SandboxedLibrary::getCallStatus() {
+	return status();
+}
+
+uint32_t SandboxedLibrary::resolve( const char* name ) {
+	if( !this->isLoaded() || strlen( name ) >= LIBLOAD_SANDBOX_NAME ) return UINT32_MAX;
+
+	uint32_t symbol = UINT32_MAX;
+
+	{
+		std::lock_guard<std::mutex> lock( this->mutex );
+		uint32_t count = this->shared->symbols.load();
+
+		for( uint32_t i = 0; i < count; i ++ ) {
+			if( strcmp( this->shared->names[i], name ) == 0 ) symbol = i;
+		}
+
+		if( symbol == UINT32_MAX ) {
+			if( count == LIBLOAD_SANDBOX_SYMBOLS ) return UINT32_MAX;
+
+			strcpy( this->shared->names[count], name );
+			this->shared->symbols.store( count + 1 );
+			symbol = count;
+		}
+	}
+
+	// ask the host if the symbol exists, a call without an invoker only looks it up
+	uint32_t ticket;
+	__LibloadSandboxSlot* slot = this->acquire( ticket );
+	slot->symbol = symbol;
+	slot->invoker = nullptr;
+
+	bool success = this->submit( slot );
+	this->release( slot, ticket );
+
+	return success ? symbol : UINT32_MAX;
+}
+
+__LibloadSandboxSlot* SandboxedLibrary::acquire( uint32_t& ticket ) {
+	ticket = this->shared->head.fetch_add( 1 );
+	__LibloadSandboxSlot* slot = &this->shared->slots[ticket % LIBLOAD_SANDBOX_SLOTS];
+
+	// only waits when all slots are in use
+	if( slot->turn.load() != ticket ) {
+		slot->queued.fetch_add( 1 );
+
+		uint32_t turn;
+		while( (turn = slot->turn.load()) != ticket ) {
+			__libload_wait( slot->turn, turn );
+		}
+
+		slot->queued.fetch_sub( 1 );
+	}
+
+	return slot;
+}
+
+bool SandboxedLibrary::submit( __LibloadSandboxSlot* slot ) {
+	if( this->shared->status.load() != __LIBLOAD_READY ) {
+		status() = CALL_UNAVAILABLE;
+		return false;
+	}
+
+	slot->state.store( __LIBLOAD_REQUEST );
+	this->shared->bell.fetch_add( 1 );
+
+	if( this->shared->sleeping.load() ) {
+		__libload_wake( this->shared->bell );
+	}
+
+	uint32_t state;
+	for( int i = 0; (state = slot->state.load()) == __LIBLOAD_REQUEST || state == __LIBLOAD_RUNNING; i ++ ) {
+		if( i < __libload_spin ) continue;
+
+		// the timeout only matters if the sandbox fails for good while we are queued
+		if( this->shared->status.load() != __LIBLOAD_READY && slot->state.compare_exchange_strong( state, __LIBLOAD_CRASHED ) ) {
+			continue;
+		}
+
+		timespec timeout { 0, 100000000 };
+		slot->waiting.store( 1 );
+		if( slot->state.load() == state && i > __libload_spin ) this->alive();
+		if( slot->state.load() == state ) __libload_wait( slot->state, state, &timeout );
+		slot->waiting.store( 0 );
+	}
+
+	status() = state == __LIBLOAD_DONE ? CALL_OK : (state == __LIBLOAD_MISSING ? CALL_MISSING : CALL_CRASHED);
+	return state == __LIBLOAD_DONE;
+}
+
+// the supervisor can be killed from outside (OOM killer, SIGKILL, or its parent death signal
+// when the thread that created the sandbox exits), then the status would stay READY forever
+bool SandboxedLibrary::alive() {
+	std::lock_guard<std::mutex> lock( this->mutex );
+	if( this->supervisor <= 0 ) return false;
+
+	pid_t result = waitpid( this->supervisor, nullptr, WNOHANG );
+	if( result == 0 || (result < 0 && errno == EINTR) ) return true;
+
+	// reaped now or already gone (ECHILD), either way it's not coming back
+	this->supervisor = -1;
+	if( this->shared->status.load() == __LIBLOAD_READY ) {
+		snprintf( this->shared->error, sizeof(this->shared->error), "supervisor process died" );
+		__libload_abandon( this->shared );
+	}
+
+	return false;
+}
+
+void SandboxedLibrary::release( __LibloadSandboxSlot* slot, uint32_t ticket ) {
+	slot->state.store( __LIBLOAD_IDLE );
+	slot->turn.store( ticket + LIBLOAD_SANDBOX_SLOTS );
+	if( slot->queued.load() ) __libload_wake( slot->turn );
+}
+
+#endif
+
+#if defined(LIBLOAD_LOADER) && defined(LIBLOAD_LINUX)
+
+LibraryLoader::LibraryLoader( const char* directory, int flags, unsigned threads ) {
+	auto begin = std::chrono::steady_clock::now();
+	if( threads == 0 ) threads = std::max( 1u, std::thread::hardware_concurrency() );
+
+	DIR* dir = opendir( directory );
+	if( !dir ) {
+		this->status = "unable to open directory";
+		return;
+	}
+
+	std::vector<std::string> names;
+	while( struct dirent* entry = readdir( dir ) ) {
+		size_t length = strlen( entry->d_name );
+		if( length > 3 && strcmp( entry->d_name + length - 3, ".so" ) == 0 ) names.push_back( entry->d_name );
+	}
+
+	closedir( dir );
+	std::sort( names.begin(), names.end() );
+
+	this->libraries.resize( names.size() );
+	for( size_t i = 0; i < names.size(); i ++ ) {
+		this->libraries[i].name = names[i];
+		this->libraries[i].path = std::string( directory ) + "/" + names[i];
+	}
+
+	// reading the whole file also warms the page cache for dlopen()
+	parallel( this->libraries.size(), threads, [&] ( size_t i ) {
+		LoadedLibrary& entry = this->libraries[i];
+		LibraryInfo info( entry.path.c_str(), true );
+
+		entry.soname = info.getSoname();
+		entry.needed.assign( info.getNeeded().begin(), info.getNeeded().end() );
+	} );
+
+	this->order();
+
+	// open one level at a time, everything within a level is independent
+	for( size_t start = 0; start < this->libraries.size(); ) {
+		size_t end = start;
+		while( end < this->libraries.size() && this->libraries[end].level == this->libraries[start].level ) end ++;
+
+		parallel( end - start, threads, [&] ( size_t i ) {
+			LoadedLibrary& entry = this->libraries[start + i];
+			auto time = std::chrono::steady_clock::now();
+
+			entry.library.reset( new DynamicLibrary( entry.path.c_str(), flags ) );
+			entry.milliseconds = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - time ).count();
+			if( !entry.library->isLoaded() ) entry.error = DynamicLibrary::getError();
+		} );
+
+		start = end;
+	}
+
+	for( LoadedLibrary& entry : this->libraries ) {
+		if( !entry.library->isLoaded() && this->status.empty() ) {
+			this->status = entry.name + ": " + entry.error;
+		}
+	}
+
+	this->milliseconds = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+}
+
+void LibraryLoader::order() {
+	const size_t count = this->libraries.size();
+	std::unordered_map<std::string, size_t> names;
+
+	for( size_t i = 0; i < count; i ++ ) {
+		names[this->libraries[i].name] = i;
+		if( !this->libraries[i].soname.empty() ) names[this->libraries[i].soname] = i;
+	}
+
+	// Kahn's algorithm, processed in waves so that each library gets its depth
+	std::vector<std::vector<size_t>> dependents( count );
+	std::vector<size_t> pending( count, 0 );
+
+	for( size_t i = 0; i < count; i ++ ) {
+		for( const std::string& name : this->libraries[i].needed ) {
+			auto found = names.find( name );
+
+			if( found != names.end() && found->second != i ) {
+				dependents[found->second].push_back( i );
+				pending[i] ++;
+			}
+		}
+	}
+
+	std::vector<size_t> wave, next;
+	size_t visited = 0;
+	unsigned level = 0;
+
+	for( size_t i = 0; i < count; i ++ ) {
+		if( pending[i] == 0 ) wave.push_back( i );
+	}
+
+	while( !wave.empty() ) {
+		for( size_t i : wave ) {
+			this->libraries[i].level = level;
+			visited ++;
+
+			for( size_t dependent : dependents[i] ) {
+				if( -- pending[dependent] == 0 ) next.push_back( dependent );
+			}
+		}
+
+		wave.swap( next );
+		next.clear();
+		level ++;
+	}
+
+	// whatever is left is part of a cycle, try to open it last anyway
+	if( visited != count ) {
+		this->status = "dependency cycle";
+
+		for( size_t i = 0; i < count; i ++ ) {
+			if( pending[i] ) this->libraries[i].level = level;
+		}
+	}
+
+	std::stable_sort( this->libraries.begin(), this->libraries.end(), [] ( const LoadedLibrary& a, const LoadedLibrary& b ) {
+		return a.level < b.level;
+	} );
+}
+
+bool LibraryLoader::isComplete() {
+	return this->status.empty();
+}
+
+std::string& LibraryLoader::getMessage() {
+	return this->status;
+}
+
+std::vector<LoadedLibrary>& LibraryLoader::getLibraries() {
+	return this->libraries;
+}
+
+double LibraryLoader::getMilliseconds() {
+	return this->milliseconds;
+}
+
+DynamicLibrary* LibraryLoader::find( const char* name ) {
+	for( LoadedLibrary& entry : this->libraries ) {
+		if( entry.name == name || entry.soname == name ) return entry.library.get();
+	}
+
+	return nullptr;
+}
+
+#endif
+
+#if defined(LIBLOAD_HOT_RELOAD) && defined(LIBLOAD_LINUX)
+
+struct __LibloadSlot {
+	std::atomic<uint64_t> epoch {0};
+	std::atomic<bool> owned {false};
+	char padding[48];
+};
+
+static __LibloadSlot __libload_slots[LIBLOAD_MAX_READERS];
+static std::atomic<uint64_t> __libload_epoch {1};
+
+// readers that didn't get a slot publish their epochs here, under the lock
+static std::mutex __libload_overflow_lock;
+static std::multiset<uint64_t> __libload_overflow;
+
+// claims reader slot on first use, releases it when the thread exits
+struct __LibloadReader {
+	unsigned slot = (unsigned) -1;
+	unsigned depth = 0;
+	std::multiset<uint64_t>::iterator overflow;
+
+	// returns LIBLOAD_MAX_READERS if all slots are taken
+	unsigned claim() {
+		for( unsigned i = 0; i < LIBLOAD_MAX_READERS && this->slot == (unsigned) -1; i ++ ) {
+			bool expected = false;
+
+			// plain load first, failed exchanges would keep stealing the owners' cache lines
+			if( !__libload_slots[i].owned.load( std::memory_order_relaxed ) && __libload_slots[i].owned.compare_exchange_strong( expected, true ) ) {
+				this->slot = i;
+			}
+		}
+
+		return this->slot == (unsigned) -1 ? LIBLOAD_MAX_READERS : this->slot;
+	}
+
+	~__LibloadReader() {
+		if( this->slot != (unsigned) -1 ) {
+			__libload_slots[this->slot].epoch.store( 0 );
+			__libload_slots[this->slot].owned.store( false );
+		}
+	}
+};
+
+static thread_local __LibloadReader __libload_reader;
+
+unsigned __LibloadEpoch::enter() {
+	unsigned slot = __libload_reader.slot;
+
+	if( __libload_reader.depth ++ == 0 ) {
+		if( slot == (unsigned) -1 ) slot = __libload_reader.claim();
+
+		if( slot == LIBLOAD_MAX_READERS ) {
+			std::lock_guard<std::mutex> lock( __libload_overflow_lock );
+			__libload_reader.overflow = __libload_overflow.insert( __libload_epoch.load() );
+		}else{
+			__libload_slots[slot].epoch.store( __libload_epoch.load() );
+		}
+	}else if( slot == (unsigned) -1 ) {
+		slot = LIBLOAD_MAX_READERS;
+	}
+
+	return slot;
+}
+
+void __LibloadEpoch::exit( unsigned slot ) {
+	assert( __libload_reader.depth > 0 && (slot == LIBLOAD_MAX_READERS || slot == __libload_reader.slot) && "Guard destroyed on a different thread than it was acquired on" );
+
+	if( -- __libload_reader.depth == 0 ) {
+		if( slot == LIBLOAD_MAX_READERS ) {
+			std::lock_guard<std::mutex> lock( __libload_overflow_lock );
+			__libload_overflow.erase( __libload_reader.overflow );
+		}else{
+			__libload_slots[slot].epoch.store( 0, std::memory_order_release );
+		}
+	}
+}
+
+uint64_t __LibloadEpoch::advance() {
+	return __libload_epoch.fetch_add( 1 ) + 1;
+}
+
+bool __LibloadEpoch::reading() {
+	return __libload_reader.depth > 0;
+}
+
+bool __LibloadEpoch::quiescent( uint64_t epoch ) {
+	for( unsigned i = 0; i < LIBLOAD_MAX_READERS; i ++ ) {
+		uint64_t value = __libload_slots[i].epoch.load();
+		if( value != 0 && value < epoch ) return false;
+	}
+
+	std::lock_guard<std::mutex> lock( __libload_overflow_lock );
+	return __libload_overflow.empty() || *__libload_overflow.begin() >= epoch;
+}
+
+#endif
+
+#if defined(LIBLOAD_BENCHMARK) && defined(LIBLOAD_LINUX)
+
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <unordered_map>
+#include <dirent.h>
+
+struct __LibloadBenchmark {
+	std::string directory;
+	std::vector<std::string> paths;
+	std::vector<std::string> names;
+	std::atomic<long> errors {0};
+
+	static double now() {
+		return std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+	}
+
+	static void report( const char* name, double nanoseconds, size_t count ) {
+		printf( "%-28s %12zu %14.1f ns\n", name, count, nanoseconds / (count ? count : 1) );
+	}
+
+	static bool copy( const std::string& from, const std::string& to ) {
+		int input = open( from.c_str(), O_RDONLY | O_CLOEXEC );
+		if( input == -1 ) return false;
+
+		int output = open( to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755 );
+		if( output == -1 ) {
+			::close( input );
+			return false;
+		}
+
+		char buffer[65536];
+		ssize_t length;
+		bool success = true;
+
+		while( success && (length = read( input, buffer, sizeof(buffer) )) != 0 ) {
+			if( length == -1 ) {
+				success = errno == EINTR;
+				continue;
+			}
+
+			for( ssize_t offset = 0; success && offset < length; ) {
+				ssize_t written = write( output, buffer + offset, length - offset );
+				if( written > 0 ) offset += written;
+				else success = written == -1 && errno == EINTR;
+			}
+		}
+
+		::close( input );
+		return ::close( output ) == 0 && success;
+	}
+
+	bool generate( int libraries, int symbols ) {
+		char temp[] = "/tmp/libload-bench-XXXXXX";
+		if( !mkdtemp( temp ) ) return false;
+
+		this->directory = temp;
+		std::string source = this->directory + "/bench.c";
+		FILE* file = fopen( source.c_str(), "w" );
+		if( !file ) return false;
+
+		for( int i = 0; i < symbols; i ++ ) {
+			fprintf( file, "int bench_%d(void) { return %d; }\n", i, i );
+			this->names.push_back( "bench_" + std::to_string( i ) );
+		}
+
+		fclose( file );
+
+		const char* compiler = getenv( "CC" );
+		std::string library = this->directory + "/bench.so";
+		std::string command = std::string( compiler ? compiler : "cc" ) + " -shared -fPIC -O1 -o " + library + " " + source;
+		if( system( command.c_str() ) != 0 ) return false;
+
+		// every copy is a separate file, so each one is loaded on its own
+		for( int i = 0; i < libraries; i ++ ) {
+			std::string path = this->directory + "/bench_" + std::to_string( i ) + ".so";
+
+			if( !copy( library, path ) ) return false;
+			this->paths.push_back( path );
+		}
+
+		return true;
+	}
+
+	// the directory only ever contains plain files created by the benchmark
+	void cleanup() {
+		if( this->directory.empty() ) return;
+
+		if( DIR* dir = opendir( this->directory.c_str() ) ) {
+			while( struct dirent* entry = readdir( dir ) ) {
+				std::string name = entry->d_name;
+				if( name != "." && name != ".." ) unlink( (this->directory + "/" + name).c_str() );
+			}
+
+			closedir( dir );
+		}
+
+		if( rmdir( this->directory.c_str() ) != 0 ) fprintf( stderr, "failed to remove %s\n", this->directory.c_str() );
+	}
+
+	void check( void* function, int expected ) {
+		if( !function || ((int (*)()) function)() != expected ) this->errors ++;
+	}
+
+	void single( int flags, const char* label ) {
+		std::vector<DynamicLibrary> libraries;
+		libraries.reserve( this->paths.size() );
+
+		double start = now();
+		for( std::string& path : this->paths ) libraries.emplace_back( path.c_str(), flags );
+		report( label, now() - start, this->paths.size() );
+
+		for( DynamicLibrary& library : libraries ) {
+			if( !library.isLoaded() ) this->errors ++;
+		}
+
+		if( flags != DynamicLibrary::LAZY ) return;
+		size_t count = this->paths.size() * this->names.size();
+
+		start = now();
+		for( DynamicLibrary& library : libraries ) {
+			for( size_t i = 0; i < this->names.size(); i ++ ) this->check( library.fetch<void*>( this->names[i].c_str() ), i );
+		}
+		report( "fetch (first)", now() - start, count );
+
+		std::vector<std::vector<void*>> tables( libraries.size() );
+
+		start = now();
+		for( size_t l = 0; l < libraries.size(); l ++ ) {
+			LibraryInfo info( this->paths[l].c_str() );
+			tables[l] = libraries[l].fetchAll( info.find( "bench_" ) );
+
+			if( tables[l].size() != this->names.size() ) this->errors ++;
+		}
+		report( "fetchAll (with LibraryInfo)", now() - start, count );
+
+		// names are mapped to a slot once, after that lookups only touch the cached tables,
+		// all copies are the same file so the symbols come out of find() in the same order
+		LibraryInfo info( this->paths.back().c_str() );
+		std::vector<const LibrarySymbol*> symbols = info.find( "bench_" );
+		std::unordered_map<std::string, size_t> slots;
+		for( size_t i = 0; i < symbols.size(); i ++ ) slots.emplace( symbols[i]->name, i );
+
+		start = now();
+		for( size_t l = 0; l < libraries.size(); l ++ ) {
+			for( size_t i = 0; i < this->names.size(); i ++ ) {
+				auto slot = slots.find( this->names[i] );
+				this->check( slot == slots.end() ? nullptr : tables[l][slot->second], i );
+			}
+		}
+		report( "fetch (cached table)", now() - start, count );
+
+		std::vector<int (*)()> table;
+		for( std::string& name : this->names ) table.push_back( libraries[0].fetch<int (*)()>( name.c_str() ) );
+
+		long sum = 0;
+		start = now();
+		for( int round = 0; round < 10000; round ++ ) {
+			for( int (*function)() : table ) sum += function();
+		}
+		report( "call through table", now() - start, 10000 * table.size() );
+
+		if( sum != 10000L * (long) (this->names.size() * (this->names.size() - 1) / 2) ) this->errors ++;
+
+		start = now();
+		for( DynamicLibrary& library : libraries ) library.close();
+		report( "close", now() - start, libraries.size() );
+	}
+
+	void parallel( int threads ) {
+		std::vector<DynamicLibrary> libraries;
+		for( std::string& path : this->paths ) libraries.emplace_back( path.c_str() );
+
+		std::vector<std::thread> workers;
+		double start = now();
+
+		for( int t = 0; t < threads; t ++ ) {
+			workers.emplace_back( [&, t] () {
+				for( size_t l = t; l < libraries.size() * threads; l += threads ) {
+					DynamicLibrary copy( libraries[l % libraries.size()] );
+					for( size_t i = 0; i < this->names.size(); i ++ ) this->check( copy.fetch<void*>( this->names[i].c_str() ), i );
+				}
+			} );
+		}
+
+		for( std::thread& worker : workers ) worker.join();
+		report( "fetch (threads)", now() - start, libraries.size() * this->names.size() );
+
+		libraries.clear();
+		workers.clear();
+		start = now();
+
+		// every thread opens and closes its own share of libraries over and over
+		for( int t = 0; t < threads; t ++ ) {
+			workers.emplace_back( [&, t] () {
+				for( int round = 0; round < 4; round ++ ) {
+					for( size_t l = t; l < this->paths.size(); l += threads ) {
+						DynamicLibrary library( this->paths[l].c_str() );
+						this->check( library.fetch<void*>( this->names[0].c_str() ), 0 );
+					}
+				}
+			} );
+		}
+
+		for( std::thread& worker : workers ) worker.join();
+		report( "open + close (threads)", now() - start, 4 * this->paths.size() );
+	}
+
+#ifdef LIBLOAD_HOT_RELOAD
+	struct Table {
+		int (*first)();
+	};
+
+	static bool bind( DynamicLibrary& dl, Table& table ) {
+		return SymbolBinder( dl ).bind( table.first, "bench_0" ).isComplete();
+	}
+
+	void churn( int threads ) {
+		std::string path = this->directory + "/reload.so";
+		if( !copy( this->paths[0], path ) ) return;
+
+		ReloadableLibrary<Table> library( path.c_str(), bind );
+		std::atomic<bool> running {true};
+		std::atomic<long> calls {0};
+		std::vector<std::thread> workers;
+
+		for( int t = 0; t < threads; t ++ ) {
+			workers.emplace_back( [&] () {
+				long count = 0;
+
+				while( running.load( std::memory_order_relaxed ) ) {
+					auto table = library.acquire();
+					if( !table || table->first() != 0 ) this->errors ++;
+					count ++;
+				}
+
+				calls += count;
+			} );
+		}
+
+		double start = now();
+		const int reloads = 50;
+
+		for( int i = 0; i < reloads; i ++ ) {
+			if( !library.reload() ) this->errors ++;
+		}
+
+		double elapsed = now() - start;
+		running = false;
+		for( std::thread& worker : workers ) worker.join();
+
+		report( "reload (under load)", elapsed, reloads );
+		report( "acquire + call (threads)", elapsed * threads, calls.load() );
+	}
+#endif
+
+};
+
+int main( int argc, char** argv ) {
+	int libraries = argc > 1 ? atoi( argv[1] ) : 200;
+	int symbols = argc > 2 ? atoi( argv[2] ) : 64;
+	int threads = argc > 3 ? atoi( argv[3] ) : 4;
+
+	if( libraries < 1 || symbols < 1 || threads < 1 ) {
+		fprintf( stderr, "usage: %s [libraries] [symbols] [threads]\n", argv[0] );
+		return 2;
+	}
+
+	__LibloadBenchmark benchmark;
+
+	if( !benchmark.generate( libraries, symbols ) ) {
+		fprintf( stderr, "failed to generate libraries\n" );
+		benchmark.cleanup();
+		return 2;
+	}
+
+	printf( "%d libraries, %d symbols, %d threads\n", libraries, symbols, threads );
+	printf( "%-28s %12s %17s\n", "operation", "count", "average" );
+
+	benchmark.single( DynamicLibrary::LAZY, "open (lazy)" );
+	benchmark.single( DynamicLibrary::NOW | DynamicLibrary::PREFAULT, "open (now, prefault)" );
+	benchmark.parallel( threads );
+
+#ifdef LIBLOAD_HOT_RELOAD
+	benchmark.churn( threads );
+#endif
+
+	benchmark.cleanup();
+	printf( "errors: %ld\n", benchmark.errors.load() );
+
+	return benchmark.errors.load() ? 1 : 0;
+}
+
+#endif
 
 #undef LIBLOAD_IMPLEMENT
 #endif
@@ -26,9 +26,15 @@
 
 /* Options: (define to enable, only one can be selected)
  * TERMCO_NONE            - Define only base. (only __TERMCO_ANSI_* codes)
+ * TERMCO_AUTO_ANSI       - Pick ANSI flavor for the platform at compile time.
  * TERMCO_STD_ANSI        - Use standard ANSI color codes.
  * TERMCO_WIN_ANSI        - Use Windows 10 flavor of ANSI.
  * TERMCO_COLOR_ID        - Defines color ids and termco_get() function.
+ * TERMCO_STREAM          - Defines streaming escape stripper termco_stream_*() and termco_filter().
+ * TERMCO_LAYOUT          - Defines visible width and table layout functions.
+ * TERMCO_LIVE            - Defines TermcoRegion class for live progress lines. (C++ only)
+ * TERMCO_SINK            - Defines buffered output termco_sink_*() that counts bytes and write calls.
+ * TERMCO_BENCHMARK       - Defines main() comparing output strategies, see Benchmark below.
  * TERMCO_IMPLEMENTATION  - If defined this file will act as .c not .h
  * TERMCO_WINDOWS         - Don't check build environment, assume windows.
  * TERMCO_LINUX           - Don't check build environment, assume linux-like.
@@ -43,12 +49,60 @@
  *  B_<COLOR> - Set background color.
  *  S_<BOLD/UNDERLINE/BLINK/DIM> - Set text feature.
  *  termco_init() to enable, termco_exit() to disable
+ *  termco_detect() to get cached terminal profile (tty and color depth)
+ *  termco_code( code ) - Returns code, or "" when termco_init() found no color support.
  *
  * Colors:
  *  WHITE, BLACK, GRAY, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN.
  *
  * Light/Strong variants:
  *  L_GRAY, L_RED, L_GREEN, L_YELLOW, L_BLUE, L_MAGENTA, L_CYAN
+ *
+ * Detection:
+ *  Done once by termco_detect() (and so termco_init()), result is cached for the whole process, safe to call from any thread.
+ *  Checks if stdout is a TTY, NO_COLOR, FORCE_COLOR, TERM, COLORTERM and terminfo max_colors.
+ *  Depth is one of TERMCO_DEPTH_NONE, TERMCO_DEPTH_16, TERMCO_DEPTH_256 or TERMCO_DEPTH_TRUE.
+ *  termco_init() sets termco_enabled, color macros always stay string literals (so F_RED "text" works),
+ *  use termco_code( F_RED ) or termco_get() to get an empty string when colors are not supported.
+ *
+ * Streams: (TERMCO_STREAM)
+ *  termco_stream_init( &stream, mode ) - Prepare stream state, mode is TERMCO_STREAM_STRIP or TERMCO_STREAM_DOWNGRADE.
+ *  termco_stream_feed( &stream, in, n, out ) - Process next chunk, returns bytes written to out.
+ *  termco_stream_flush( &stream, out ) - Finish the stream, returns bytes written to out.
+ *  termco_filter( in, out, mode ) - Process whole FILE, returns 0 on success.
+ *
+ *  Output buffer must hold at least n + TERMCO_STREAM_MAX bytes. Sequences can be split
+ *  between chunks at any byte. STRIP removes all escape sequences, DOWNGRADE rewrites
+ *  256 color and truecolor SGR codes into the nearest of the 16 base colors.
+ *
+ * Layout: (TERMCO_LAYOUT)
+ *  termco_width( str, n ) - Display width of str, escapes are ignored and UTF-8 wide chars count as two.
+ *  termco_cell( out, str, n, width, align ) - Print str padded (or cut) to the given width.
+ *  termco_row( out, cells, columns, count, separator ) - Print a row of cells followed by a new line.
+ *  termco_bar( out, progress, width, fill, empty ) - Print progress bar, progress is in range [0, 1].
+ *
+ *  Alignment is one of TERMCO_ALIGN_LEFT, TERMCO_ALIGN_RIGHT or TERMCO_ALIGN_CENTER,
+ *  everything is written directly to the FILE without building temporary strings.
+ *
+ * Live region: (TERMCO_LIVE)
+ *  TermcoRegion region( lines, rate ) - Create region of progress lines, redrawn rate times per second (20 by default, at most 1000).
+ *  region.start() / region.stop() - Start or stop the render thread, stop() draws the final state.
+ *  region.label( line, text ) - Set line label.
+ *  region.update( line, done, total ) - Set line progress.
+ *  region.advance( line, delta ) - Add to line progress.
+ *
+ *  Workers only touch atomics and never block, all terminal output is done by the render thread.
+ *  Each line should have a single writer. When the output stream is not a TTY only the final state is drawn.
+ *
+ * Sink: (TERMCO_SINK)
+ *  termco_sink_init( &sink, fd ) - Prepare buffered output to the given file descriptor.
+ *  termco_sink_write( &sink, data, n ) - Append data, calls write() only when the buffer is full.
+ *  termco_sink_puts( &sink, str ) - Append null terminated string.
+ *  termco_sink_flush( &sink ) - Write out buffered data, returns 0 on success and -1 on error.
+ *
+ *  sink.bytes and sink.writes hold the number of bytes and write() calls made so far,
+ *  buffer size can be changed by defining TERMCO_SINK_SIZE. Interrupted writes are retried,
+ *  any other failure (including EAGAIN) is stored in sink.error and later output is dropped.
  */
 
 /* Example:
@@ -60,8 +114,29 @@
  *  }
  */
 
+/* Filter example:
+ *  int main() {
+ *    return termco_filter( stdin, stdout, TERMCO_STREAM_STRIP );
+ *  }
+ */
+
+/* Benchmark: (TERMCO_BENCHMARK with TERMCO_SINK and TERMCO_IMPLEMENTATION, not on Windows)
+ *  cc -x c -O2 -DTERMCO_STD_ANSI -DTERMCO_SINK -DTERMCO_IMPLEMENTATION -DTERMCO_BENCHMARK termco.h -o bench
+ *  ./bench [target=/dev/null]
+ *
+ *  Defines main(), renders colored logs, a redrawn dashboard and a table three ways: naive (one
+ *  write() per escape and cell), buffered (same bytes through a sink) and diffed (only changed cells,
+ *  colors emitted only when they change). Prints bytes, write() calls and ns/cell for each, target
+ *  is a file path or "pty" to write into a pseudo terminal drained by a child process.
+ */
+
 /* Versions:
  * 1.0 - Initial version.
+ * 1.1 - Added escape sequence streams.
+ * 1.2 - Added layout functions.
+ * 1.3 - Added live region.
+ * 1.4 - Added runtime terminal detection.
+ * 1.5 - Added output sink.
  */
 
 #ifdef TERMCO_WINDOWS
@@ -85,6 +160,11 @@
 #ifndef TERMCO_H
 #define TERMCO_H
 
+/* benchmark uses posix_openpt() and friends, those need X/Open extensions on glibc */
+#if defined(TERMCO_BENCHMARK) && defined(TERMCO_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -93,8 +173,143 @@ extern "C" {
 #include <windows.h>
 #endif
 
+#define TERMCO_DEPTH_NONE 0
+#define TERMCO_DEPTH_16 1
+#define TERMCO_DEPTH_256 2
+#define TERMCO_DEPTH_TRUE 3
+
+typedef struct {
+    int tty;
+    int depth;
+} termco_profile;
+
 #ifdef TERMCO_IMPLEMENTATION
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __TERMCO_WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+int termco_enabled = 1;
+static termco_profile __termco_profile;
+
+#ifndef __TERMCO_WINDOWS
+/* reads max_colors from compiled terminfo entry, returns -1 if there is no entry */
+static long __termco_terminfo_colors( const char* term ) {
+    const char* dirs[5] = { getenv( "TERMINFO" ), NULL, "/etc/terminfo", "/lib/terminfo", "/usr/share/terminfo" };
+    char home[512], path[1024];
+    unsigned char data[4096];
+    int i, layout;
+
+    if( getenv( "HOME" ) ) {
+        snprintf( home, sizeof(home), "%s/.terminfo", getenv( "HOME" ) );
+        dirs[1] = home;
+    }
+
+    for( i = 0; i < 5; i ++ ) {
+        for( layout = 0; layout < 2 && dirs[i]; layout ++ ) {
+            FILE* file;
+            size_t size, offset;
+
+            /* linux uses 'x/xterm', macOS uses '78/xterm' */
+            if( layout == 0 ) snprintf( path, sizeof(path), "%s/%c/%s", dirs[i], term[0], term );
+            else snprintf( path, sizeof(path), "%s/%02x/%s", dirs[i], (unsigned char) term[0], term );
+
+            if( (file = fopen( path, "rb" )) == NULL ) continue;
+            size = fread( data, 1, sizeof(data), file );
+            fclose( file );
+
+            if( size < 12 ) continue;
+
+            int magic = data[0] | data[1] << 8;
+            int wide = (magic == 01036);
+            if( magic != 0432 && !wide ) continue;
+
+            size_t names = data[2] | data[3] << 8;
+            size_t bools = data[4] | data[5] << 8;
+            size_t numbers = data[6] | data[7] << 8;
+
+            /* max_colors is the numeric capability number 13, absent means no colors */
+            if( numbers <= 13 ) return 0;
+            offset = 12 + names + bools;
+            offset += offset & 1;
+            offset += 13 * (wide ? 4 : 2);
+
+            if( offset + (wide ? 4 : 2) > size ) return -1;
+
+            long colors = wide ? (long) (int) (data[offset] | data[offset + 1] << 8 | data[offset + 2] << 16 | (unsigned) data[offset + 3] << 24)
+                               : (long) (short) (data[offset] | data[offset + 1] << 8);
+
+            return colors < 0 ? 0 : colors;
+        }
+    }
+
+    return -1;
+}
+#endif
+
+/* runs exactly once, termco_detect() can be called from many threads at the same time */
+static void __termco_detect_once( void ) {
+    termco_profile profile;
+    const char* force = getenv( "FORCE_COLOR" );
+    const char* none = getenv( "NO_COLOR" );
+
+#ifdef __TERMCO_WINDOWS
+    profile.tty = _isatty( _fileno( stdout ) );
+    profile.depth = profile.tty ? TERMCO_DEPTH_TRUE : TERMCO_DEPTH_NONE;
+#else
+    const char* term = getenv( "TERM" );
+    const char* colorterm = getenv( "COLORTERM" );
+
+    profile.tty = isatty( STDOUT_FILENO );
+    profile.depth = TERMCO_DEPTH_NONE;
+
+    if( term && *term && strcmp( term, "dumb" ) != 0 ) {
+        long colors = __termco_terminfo_colors( term );
+
+        if( colors < 0 ) colors = strstr( term, "256" ) ? 256 : 8;
+        if( colorterm && (strcmp( colorterm, "truecolor" ) == 0 || strcmp( colorterm, "24bit" ) == 0) ) colors = 0x1000000;
+
+        profile.depth = colors >= 0x1000000 ? TERMCO_DEPTH_TRUE : colors >= 256 ? TERMCO_DEPTH_256 : colors >= 8 ? TERMCO_DEPTH_16 : TERMCO_DEPTH_NONE;
+    }
+
+    if( !profile.tty ) profile.depth = TERMCO_DEPTH_NONE;
+#endif
+
+    if( force && *force && profile.depth == TERMCO_DEPTH_NONE ) profile.depth = TERMCO_DEPTH_16;
+    if( none && *none ) profile.depth = TERMCO_DEPTH_NONE;
+
+    __termco_profile = profile;
+}
+
+#ifdef __TERMCO_WINDOWS
+static BOOL CALLBACK __termco_detect_callback( PINIT_ONCE once, PVOID parameter, PVOID* context ) {
+    (void) once;
+    (void) parameter;
+    (void) context;
+    __termco_detect_once();
+    return TRUE;
+}
+#endif
+
+const termco_profile* termco_detect() {
+#ifdef __TERMCO_WINDOWS
+    static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+    InitOnceExecuteOnce( &once, __termco_detect_callback, NULL, NULL );
+#else
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once( &once, __termco_detect_once );
+#endif
+
+    return &__termco_profile;
+}
+
 void termco_exit() {
 
 #ifdef __TERMCO_WINDOWS
@@ -109,6 +324,9 @@ void termco_exit() {
 
 void termco_init() {
 
+    termco_enabled = termco_detect()->depth != TERMCO_DEPTH_NONE;
+    if( !termco_enabled ) return;
+
 #ifdef __TERMCO_WINDOWS
     HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
     DWORD mode = 0;
@@ -122,6 +340,9 @@ void termco_init() {
 
 #else
 
+extern int termco_enabled;
+
+const termco_profile* termco_detect();
 void termco_init();
 void termco_exit();
 
@@ -183,17 +404,27 @@ void termco_exit();
 
 #endif
 
+#ifdef TERMCO_AUTO_ANSI
+#ifdef __TERMCO_WINDOWS
+#define TERMCO_WIN_ANSI
+#else
+#define TERMCO_STD_ANSI
+#endif
+#endif
+
+#define termco_code(code) (termco_enabled ? (code) : __TERMCO_NOT_SUPPORTED)
+
 #ifndef TERMCO_WIN_ANSI
 #ifndef TERMCO_STD_ANSI
 #ifndef TERMCO_NONE
-#error "No profile selected! Define TERMCO_WIN_ANSI, TERMCO_STD_ANSI or TERMCO_NONE!"
+#error "No profile selected! Define TERMCO_AUTO_ANSI, TERMCO_WIN_ANSI, TERMCO_STD_ANSI or TERMCO_NONE!"
 #endif
 #endif
 #endif
 
 #ifdef TERMCO_NONE
 #ifdef TERMCO_COLOR_ID
-#error "TERMCO_COLOR_ID requires TERMCO_WIN_ANSI or TERMCO_STD_ANSI!"
+#error "TERMCO_COLOR_ID requires TERMCO_AUTO_ANSI, TERMCO_WIN_ANSI or TERMCO_STD_ANSI!"
 #endif
 #endif
 
@@ -366,6 +597,7 @@ typedef unsigned char color_t;
 #ifdef TERMCO_IMPLEMENTATION
 
 const char * termco_get( color_t color_id ) {
+
     static char colors[41][7] = {
         F_GRAY,
         F_BLACK,
@@ -410,7 +642,7 @@ const char * termco_get( color_t color_id ) {
         S_RESET
     };
 
-    return colors[color_id];
+    return termco_code( colors[color_id] );
 }
 
 #else
@@ -421,8 +653,1162 @@ const char * termco_get( color_t color_id );
 
 #endif
 
+#ifdef TERMCO_STREAM
+
+#ifndef __TERMCO_STREAM
+#define __TERMCO_STREAM
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define TERMCO_STREAM_STRIP 1
+#define TERMCO_STREAM_DOWNGRADE 2
+#define TERMCO_STREAM_MAX 64
+
+typedef struct {
+    int mode;
+    int state;
+    size_t length;
+    char pending[TERMCO_STREAM_MAX];
+} termco_stream;
+
+#endif
+
+#ifdef TERMCO_IMPLEMENTATION
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define __TERMCO_SSE2
+#endif
+
+#define __TERMCO_STATE_TEXT 0
+#define __TERMCO_STATE_ESC 1
+#define __TERMCO_STATE_CSI 2
+#define __TERMCO_STATE_CSI_RAW 3
+#define __TERMCO_STATE_OSC 4
+#define __TERMCO_STATE_OSC_ESC 5
+#define __TERMCO_STATE_NF 6
+
+#if defined(__AVX2__) || defined(__TERMCO_SSE2)
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static unsigned __termco_ctz( unsigned mask ) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward( &index, mask );
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctz( mask );
+#endif
+}
+#endif
+
+/* returns offset of the first ESC byte or length if there is none */
+static size_t __termco_find_esc( const char* data, size_t length ) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i esc = _mm256_set1_epi8( 0x1b );
+    for( ; i + 32 <= length; i += 32 ) {
+        unsigned mask = (unsigned) _mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i*) (data + i) ), esc ) );
+        if( mask ) return i + __termco_ctz( mask );
+    }
+#elif defined(__TERMCO_SSE2)
+    const __m128i esc = _mm_set1_epi8( 0x1b );
+    for( ; i + 16 <= length; i += 16 ) {
+        unsigned mask = (unsigned) _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) (data + i) ), esc ) );
+        if( mask ) return i + __termco_ctz( mask );
+    }
+#endif
+
+    if( i < length ) {
+        const char* found = (const char*) memchr( data + i, 0x1b, length - i );
+        if( found ) return (size_t) (found - data);
+    }
+
+    return length;
+}
+
+/* maps 8 bit rgb color to the closest of the 16 base colors */
+static int __termco_nearest( int r, int g, int b ) {
+    static const unsigned char palette[16][3] = {
+        {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+        {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+        {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+        {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}
+    };
+
+    int best = 0;
+    long distance = -1;
+    int i;
+
+    for( i = 0; i < 16; i ++ ) {
+        long dr = r - palette[i][0], dg = g - palette[i][1], db = b - palette[i][2];
+        long d = dr * dr + dg * dg + db * db;
+        if( distance < 0 || d < distance ) {
+            distance = d;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+/* maps xterm 256 color index to the closest of the 16 base colors */
+static int __termco_nearest_indexed( int index ) {
+    static const unsigned char levels[6] = {0, 95, 135, 175, 215, 255};
+
+    if( index < 16 ) return index;
+    if( index >= 232 ) {
+        int gray = 8 + (index - 232) * 10;
+        return __termco_nearest( gray, gray, gray );
+    }
+
+    index -= 16;
+    return __termco_nearest( levels[index / 36], levels[(index / 6) % 6], levels[index % 6] );
+}
+
+static char* __termco_put_int( char* out, int value ) {
+    char digits[12];
+    int count = 0;
+
+    do {
+        digits[count ++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while( value > 0 );
+
+    while( count > 0 ) *out ++ = digits[-- count];
+    return out;
+}
+
+/* rewrites buffered SGR sequence, output is never longer than the input */
+static size_t __termco_downgrade( const char* sequence, size_t length, char* output ) {
+    int params[TERMCO_STREAM_MAX];
+    char joined[TERMCO_STREAM_MAX];
+    int count = 0, value = -1, first = 1, i;
+    size_t j;
+    char* out = output;
+
+    /* sequence is ESC [ params m, joined[i] is set if params[i] followed a ':' */
+    joined[0] = 0;
+    for( j = 2; j < length - 1; j ++ ) {
+        char c = sequence[j];
+
+        if( c >= '0' && c <= '9' ) {
+            value = (value < 0 ? 0 : value * 10) + (c - '0');
+            if( value > 0xFFFF ) value = 0xFFFF;
+        }else if( c == ';' || c == ':' ) {
+            params[count ++] = value;
+            joined[count] = (c == ':');
+            value = -1;
+        }else{
+            memcpy( output, sequence, length );
+            return length;
+        }
+    }
+
+    params[count ++] = value;
+
+    *out ++ = '\x1b';
+    *out ++ = '[';
+
+    for( i = 0; i < count; i ++ ) {
+        int param = params[i];
+
+        if( (param == 38 || param == 48) && i + 1 < count ) {
+            int color = -1;
+
+            if( joined[i + 1] ) {
+                /* colon form, 38:5:n or 38:2:[colorspace]:r:g:b where the colorspace can be empty or omitted */
+                int group = 1;
+                while( i + group < count && joined[i + group] ) group ++;
+
+                if( params[i + 1] == 5 && group == 3 ) {
+                    color = __termco_nearest_indexed( params[i + 2] & 0xFF );
+                }else if( params[i + 1] == 2 && group >= 5 ) {
+                    int k = i + (group == 5 ? 2 : 3);
+                    color = __termco_nearest( params[k] & 0xFF, params[k + 1] & 0xFF, params[k + 2] & 0xFF );
+                }
+
+                if( color >= 0 ) i += group - 1;
+            }else if( params[i + 1] == 5 && i + 2 < count ) {
+                color = __termco_nearest_indexed( params[i + 2] & 0xFF );
+                i += 2;
+            }else if( params[i + 1] == 2 && i + 4 < count ) {
+                color = __termco_nearest( params[i + 2] & 0xFF, params[i + 3] & 0xFF, params[i + 4] & 0xFF );
+                i += 4;
+            }
+
+            if( color >= 0 ) {
+                param = (color < 8 ? 30 + color : 82 + color) + (param == 48 ? 10 : 0);
+            }
+        }
+
+        if( !first ) *out ++ = ';';
+        first = 0;
+        if( param >= 0 ) out = __termco_put_int( out, param );
+    }
+
+    *out ++ = 'm';
+    return (size_t) (out - output);
+}
+
+void termco_stream_init( termco_stream* stream, int mode ) {
+    stream->mode = mode;
+    stream->state = __TERMCO_STATE_TEXT;
+    stream->length = 0;
+}
+
+size_t termco_stream_feed( termco_stream* stream, const char* input, size_t length, char* output ) {
+    const int strip = stream->mode & TERMCO_STREAM_STRIP;
+    const int buffer = !strip && (stream->mode & TERMCO_STREAM_DOWNGRADE);
+    char* out = output;
+    size_t i = 0;
+
+    while( i < length ) {
+
+        /* fast path, copy everything up to the next ESC */
+        if( stream->state == __TERMCO_STATE_TEXT ) {
+            size_t end = i + __termco_find_esc( input + i, length - i );
+            memcpy( out, input + i, end - i );
+            out += end - i;
+            i = end;
+
+            if( i < length ) {
+                stream->state = __TERMCO_STATE_ESC;
+                i ++;
+            }
+
+            continue;
+        }
+
+        char c = input[i ++];
+
+        switch( stream->state ) {
+
+            case __TERMCO_STATE_ESC:
+                if( c == '[' ) {
+                    stream->state = buffer ? __TERMCO_STATE_CSI : __TERMCO_STATE_CSI_RAW;
+                    stream->length = 2;
+                    stream->pending[0] = '\x1b';
+                    stream->pending[1] = '[';
+                    if( !strip && !buffer ) { *out ++ = '\x1b'; *out ++ = c; }
+                    break;
+                }
+
+                if( c == '\x1b' ) {
+                    if( !strip ) *out ++ = c;
+                    break;
+                }
+
+                if( !strip || (unsigned char) c < 0x20 ) {
+                    if( !strip ) *out ++ = '\x1b';
+                    *out ++ = c;
+                }
+
+                if( c == ']' ) stream->state = __TERMCO_STATE_OSC;
+                else if( c >= 0x20 && c <= 0x2F ) stream->state = __TERMCO_STATE_NF;
+                else stream->state = __TERMCO_STATE_TEXT;
+                break;
+
+            case __TERMCO_STATE_CSI:
+                if( stream->length == TERMCO_STREAM_MAX ) {
+                    /* too long to be rewritten, pass it as-is */
+                    memcpy( out, stream->pending, stream->length );
+                    out += stream->length;
+                    stream->state = __TERMCO_STATE_CSI_RAW;
+                    i --;
+                    break;
+                }
+
+                stream->pending[stream->length ++] = c;
+
+                if( c >= 0x40 && c <= 0x7E ) {
+                    if( c == 'm' ) {
+                        out += __termco_downgrade( stream->pending, stream->length, out );
+                    }else{
+                        memcpy( out, stream->pending, stream->length );
+                        out += stream->length;
+                    }
+
+                    stream->state = __TERMCO_STATE_TEXT;
+                }
+                break;
+
+            case __TERMCO_STATE_CSI_RAW:
+                if( !strip ) *out ++ = c;
+                if( c >= 0x40 && c <= 0x7E ) stream->state = __TERMCO_STATE_TEXT;
+                break;
+
+            case __TERMCO_STATE_OSC:
+                if( !strip ) *out ++ = c;
+                if( c == '\x07' ) stream->state = __TERMCO_STATE_TEXT;
+                else if( c == '\x1b' ) stream->state = __TERMCO_STATE_OSC_ESC;
+                break;
+
+            case __TERMCO_STATE_OSC_ESC:
+                if( !strip ) *out ++ = c;
+                stream->state = (c == '\\') ? __TERMCO_STATE_TEXT : __TERMCO_STATE_OSC;
+                break;
+
+            case __TERMCO_STATE_NF:
+                if( !strip ) *out ++ = c;
+                if( c >= 0x30 && c <= 0x7E ) stream->state = __TERMCO_STATE_TEXT;
+                break;
+
+        }
+
+    }
+
+    return (size_t) (out - output);
+}
+
+size_t termco_stream_flush( termco_stream* stream, char* output ) {
+    size_t count = 0;
+
+    if( !(stream->mode & TERMCO_STREAM_STRIP) ) {
+        if( stream->state == __TERMCO_STATE_ESC ) {
+            output[count ++] = '\x1b';
+        }else if( stream->state == __TERMCO_STATE_CSI ) {
+            memcpy( output, stream->pending, stream->length );
+            count = stream->length;
+        }
+    }
+
+    stream->state = __TERMCO_STATE_TEXT;
+    stream->length = 0;
+    return count;
+}
+
+int termco_filter( FILE* input, FILE* output, int mode ) {
+    termco_stream stream;
+    char in[16384];
+    char out[sizeof(in) + TERMCO_STREAM_MAX];
+    size_t count;
+
+    termco_stream_init( &stream, mode );
+
+    while( (count = fread( in, 1, sizeof(in), input )) > 0 ) {
+        count = termco_stream_feed( &stream, in, count, out );
+        if( fwrite( out, 1, count, output ) != count ) return -1;
+    }
+
+    count = termco_stream_flush( &stream, out );
+    if( fwrite( out, 1, count, output ) != count ) return -1;
+
+    return ferror( input ) ? -1 : 0;
+}
+
+#else
+
+void termco_stream_init( termco_stream* stream, int mode );
+size_t termco_stream_feed( termco_stream* stream, const char* input, size_t length, char* output );
+size_t termco_stream_flush( termco_stream* stream, char* output );
+int termco_filter( FILE* input, FILE* output, int mode );
+
+#endif
+
+#endif
+
+#ifdef TERMCO_LAYOUT
+
+#ifndef __TERMCO_LAYOUT
+#define __TERMCO_LAYOUT
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define TERMCO_ALIGN_LEFT 0
+#define TERMCO_ALIGN_RIGHT 1
+#define TERMCO_ALIGN_CENTER 2
+
+typedef struct {
+    int width;
+    int align;
+} termco_column;
+
+#endif
+
+#ifdef TERMCO_IMPLEMENTATION
+
+#include <string.h>
+
+/* sorted code point ranges, { first, last, width } */
+static const unsigned int __termco_widths[][3] = {
+    {0x0300, 0x036F, 0}, {0x0483, 0x0489, 0}, {0x0591, 0x05BD, 0}, {0x0610, 0x061A, 0},
+    {0x064B, 0x065F, 0}, {0x0E31, 0x0E31, 0}, {0x0E34, 0x0E3A, 0}, {0x0E47, 0x0E4E, 0},
+    {0x1100, 0x115F, 2}, {0x1AB0, 0x1AFF, 0}, {0x1DC0, 0x1DFF, 0}, {0x200B, 0x200F, 0},
+    {0x2028, 0x202E, 0}, {0x2060, 0x2064, 0}, {0x20D0, 0x20FF, 0}, {0x231A, 0x231B, 2},
+    {0x2329, 0x232A, 2}, {0x23E9, 0x23EC, 2}, {0x23F0, 0x23F0, 2}, {0x23F3, 0x23F3, 2},
+    {0x25FD, 0x25FE, 2}, {0x2614, 0x2615, 2}, {0x2648, 0x2653, 2}, {0x267F, 0x267F, 2},
+    {0x2693, 0x2693, 2}, {0x26A1, 0x26A1, 2}, {0x26AA, 0x26AB, 2}, {0x26BD, 0x26BE, 2},
+    {0x26C4, 0x26C5, 2}, {0x26CE, 0x26CE, 2}, {0x26D4, 0x26D4, 2}, {0x26EA, 0x26EA, 2},
+    {0x26F2, 0x26F3, 2}, {0x26F5, 0x26F5, 2}, {0x26FA, 0x26FA, 2}, {0x26FD, 0x26FD, 2},
+    {0x2705, 0x2705, 2}, {0x270A, 0x270B, 2}, {0x2728, 0x2728, 2}, {0x274C, 0x274C, 2},
+    {0x274E, 0x274E, 2}, {0x2753, 0x2755, 2}, {0x2757, 0x2757, 2}, {0x2795, 0x2797, 2},
+    {0x27B0, 0x27B0, 2}, {0x27BF, 0x27BF, 2}, {0x2B1B, 0x2B1C, 2}, {0x2B50, 0x2B50, 2},
+    {0x2B55, 0x2B55, 2}, {0x2E80, 0x303E, 2}, {0x3041, 0x3098, 2}, {0x3099, 0x309A, 0},
+    {0x309B, 0x33FF, 2}, {0x3400, 0x4DBF, 2}, {0x4E00, 0xA4CF, 2}, {0xA960, 0xA97F, 2},
+    {0xAC00, 0xD7A3, 2}, {0xF900, 0xFAFF, 2}, {0xFE00, 0xFE0F, 0}, {0xFE10, 0xFE19, 2},
+    {0xFE20, 0xFE2F, 0}, {0xFE30, 0xFE6F, 2}, {0xFEFF, 0xFEFF, 0}, {0xFF00, 0xFF60, 2},
+    {0xFFE0, 0xFFE6, 2}, {0x16FE0, 0x16FE4, 2}, {0x17000, 0x18AFF, 2}, {0x1B000, 0x1B2FF, 2},
+    {0x1F004, 0x1F004, 2}, {0x1F0CF, 0x1F0CF, 2}, {0x1F18E, 0x1F18E, 2}, {0x1F191, 0x1F19A, 2},
+    {0x1F200, 0x1F202, 2}, {0x1F210, 0x1F23B, 2}, {0x1F240, 0x1F248, 2}, {0x1F250, 0x1F251, 2},
+    {0x1F260, 0x1F265, 2}, {0x1F300, 0x1F320, 2}, {0x1F32D, 0x1F335, 2}, {0x1F337, 0x1F37C, 2},
+    {0x1F37E, 0x1F393, 2}, {0x1F3A0, 0x1F3CA, 2}, {0x1F3CF, 0x1F3D3, 2}, {0x1F3E0, 0x1F3F0, 2},
+    {0x1F3F4, 0x1F3F4, 2}, {0x1F3F8, 0x1F43E, 2}, {0x1F440, 0x1F440, 2}, {0x1F442, 0x1F4FC, 2},
+    {0x1F4FF, 0x1F53D, 2}, {0x1F54B, 0x1F54E, 2}, {0x1F550, 0x1F567, 2}, {0x1F57A, 0x1F57A, 2},
+    {0x1F595, 0x1F596, 2}, {0x1F5A4, 0x1F5A4, 2}, {0x1F5FB, 0x1F64F, 2}, {0x1F680, 0x1F6C5, 2},
+    {0x1F6CC, 0x1F6CC, 2}, {0x1F6D0, 0x1F6D2, 2}, {0x1F6D5, 0x1F6D7, 2}, {0x1F6EB, 0x1F6EC, 2},
+    {0x1F6F4, 0x1F6FC, 2}, {0x1F7E0, 0x1F7EB, 2}, {0x1F90C, 0x1F93A, 2}, {0x1F93C, 0x1F945, 2},
+    {0x1F947, 0x1F9FF, 2}, {0x1FA70, 0x1FAFF, 2}, {0x20000, 0x2FFFD, 2}, {0x30000, 0x3FFFD, 2},
+    {0xE0001, 0xE007F, 0}, {0xE0100, 0xE01EF, 0}
+};
+
+/* number of bytes in UTF-8 sequence by its lead byte, 0 for invalid ones */
+static const unsigned char __termco_utf8_length[32] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0
+};
+
+static int __termco_char_width( unsigned int code ) {
+    size_t low = 0, high = sizeof(__termco_widths) / sizeof(__termco_widths[0]);
+
+    if( code < 0x0300 ) return 1;
+
+    while( low < high ) {
+        size_t mid = (low + high) / 2;
+
+        if( code < __termco_widths[mid][0] ) high = mid;
+        else if( code > __termco_widths[mid][1] ) low = mid + 1;
+        else return (int) __termco_widths[mid][2];
+    }
+
+    return 1;
+}
+
+/* advances over one visible character or escape sequence, returns its width or -1 for escapes */
+static int __termco_next( const unsigned char** pointer, const unsigned char* end ) {
+    const unsigned char* p = *pointer;
+    unsigned int c = *p ++;
+
+    if( c >= 0x20 && c < 0x7F ) {
+        *pointer = p;
+        return 1;
+    }
+
+    if( c == 0x1b ) {
+        if( p < end && *p == '[' ) {
+            for( p ++; p < end && !(*p >= 0x40 && *p <= 0x7E); p ++ );
+            if( p < end ) p ++;
+        }else if( p < end && *p == ']' ) {
+            for( p ++; p < end && *p != 0x07 && !(*p == 0x1b && p + 1 < end && p[1] == '\\'); p ++ );
+            if( p < end ) p += (*p == 0x07) ? 1 : 2;
+        }else{
+            while( p < end && *p >= 0x20 && *p <= 0x2F ) p ++;
+            if( p < end ) p ++;
+        }
+
+        *pointer = p;
+        return -1;
+    }
+
+    if( c < 0x80 ) {
+        *pointer = p;
+        return 0;
+    }
+
+    int length = __termco_utf8_length[c >> 3];
+    unsigned int code = c & (0x7F >> length);
+    int i;
+
+    if( length == 0 || p + length - 1 > end ) {
+        *pointer = p;
+        return 1;
+    }
+
+    for( i = 1; i < length; i ++, p ++ ) {
+        if( (*p & 0xC0) != 0x80 ) {
+            *pointer = *pointer + 1;
+            return 1;
+        }
+
+        code = (code << 6) | (*p & 0x3F);
+    }
+
+    *pointer = p;
+    return __termco_char_width( code );
+}
+
+static void __termco_pad( FILE* out, int count ) {
+    static const char spaces[] = "                                                                ";
+
+    while( count > 0 ) {
+        int chunk = count < (int) sizeof(spaces) - 1 ? count : (int) sizeof(spaces) - 1;
+        fwrite( spaces, 1, chunk, out );
+        count -= chunk;
+    }
+}
+
+size_t termco_width( const char* str, size_t length ) {
+    const unsigned char* p = (const unsigned char*) str;
+    const unsigned char* end = p + length;
+    size_t width = 0;
+
+    while( p < end ) {
+
+        /* fast path for plain ASCII runs */
+        if( *p >= 0x20 && *p < 0x7F ) {
+            width ++;
+            p ++;
+            continue;
+        }
+
+        int w = __termco_next( &p, end );
+        if( w > 0 ) width += w;
+    }
+
+    return width;
+}
+
+void termco_cell( FILE* out, const char* str, size_t length, int width, int align ) {
+    int visible = (int) termco_width( str, length );
+
+    if( visible <= width ) {
+        int padding = width - visible;
+        int before = (align == TERMCO_ALIGN_RIGHT) ? padding : (align == TERMCO_ALIGN_CENTER) ? padding / 2 : 0;
+
+        __termco_pad( out, before );
+        fwrite( str, 1, length, out );
+        __termco_pad( out, padding - before );
+        return;
+    }
+
+    /* too wide, drop characters that don't fit but keep all escapes so that colors stay intact */
+    const unsigned char* p = (const unsigned char*) str;
+    const unsigned char* end = p + length;
+    int used = 0, full = 0;
+
+    while( p < end ) {
+        const unsigned char* start = p;
+        int w = __termco_next( &p, end );
+
+        /* once a glyph doesn't fit drop the rest of the text too, a narrow char after a cut wide one would shift the content */
+        if( w >= 0 && !full && used + w > width ) full = 1;
+
+        if( w < 0 || !full ) {
+            fwrite( start, 1, p - start, out );
+            if( w > 0 ) used += w;
+        }
+    }
+
+    __termco_pad( out, width - used );
+}
+
+void termco_row( FILE* out, const char* const* cells, const termco_column* columns, int count, const char* separator ) {
+    int i;
+
+    for( i = 0; i < count; i ++ ) {
+        if( i > 0 && separator ) fputs( separator, out );
+        termco_cell( out, cells[i], strlen( cells[i] ), columns[i].width, columns[i].align );
+    }
+
+    fputc( '\n', out );
+}
+
+void termco_bar( FILE* out, double progress, int width, const char* fill, const char* empty ) {
+    int filled, i;
+
+    if( progress < 0 ) progress = 0;
+    if( progress > 1 ) progress = 1;
+    filled = (int) (progress * width + 0.5);
+
+    for( i = 0; i < filled; i ++ ) fputs( fill, out );
+    for( ; i < width; i ++ ) fputs( empty, out );
+}
+
+#else
+
+size_t termco_width( const char* str, size_t length );
+void termco_cell( FILE* out, const char* str, size_t length, int width, int align );
+void termco_row( FILE* out, const char* const* cells, const termco_column* columns, int count, const char* separator );
+void termco_bar( FILE* out, double progress, int width, const char* fill, const char* empty );
+
+#endif
+
+#endif
+
+#ifdef TERMCO_SINK
+
+#ifndef __TERMCO_SINK
+#define __TERMCO_SINK
+
+#include <stddef.h>
+
+#ifndef TERMCO_SINK_SIZE
+#define TERMCO_SINK_SIZE 8192
+#endif
+
+typedef struct {
+    int fd;
+    size_t length;
+    unsigned long long bytes;
+    unsigned long long writes;
+    int error;
+    char buffer[TERMCO_SINK_SIZE];
+} termco_sink;
+
+#endif
+
+#ifdef TERMCO_IMPLEMENTATION
+
+#include <string.h>
+#include <errno.h>
+
+#ifdef __TERMCO_WINDOWS
+#include <io.h>
+#define __TERMCO_WRITE(fd, data, length) _write( fd, data, (unsigned) (length) )
+#else
+#include <unistd.h>
+#define __TERMCO_WRITE(fd, data, length) write( fd, data, length )
+#endif
+
+static void __termco_sink_emit( termco_sink* sink, const char* data, size_t length ) {
+
+    /* after a failure everything is dropped, sink->error keeps the first errno */
+    if( sink->error ) return;
+
+    while( length > 0 ) {
+        long written = (long) __TERMCO_WRITE( sink->fd, data, length );
+        sink->writes ++;
+
+        if( written < 0 && errno == EINTR ) continue;
+
+        /* that includes EAGAIN, retrying a non-blocking fd here would just spin */
+        if( written <= 0 ) {
+            sink->error = written < 0 ? errno : EIO;
+            return;
+        }
+
+        sink->bytes += written;
+        data += written;
+        length -= written;
+    }
+}
+
+void termco_sink_init( termco_sink* sink, int fd ) {
+    sink->fd = fd;
+    sink->length = 0;
+    sink->bytes = 0;
+    sink->writes = 0;
+    sink->error = 0;
+}
+
+int termco_sink_flush( termco_sink* sink ) {
+    __termco_sink_emit( sink, sink->buffer, sink->length );
+    sink->length = 0;
+    return sink->error ? -1 : 0;
+}
+
+void termco_sink_write( termco_sink* sink, const char* data, size_t length ) {
+    if( sink->length + length > TERMCO_SINK_SIZE ) {
+        termco_sink_flush( sink );
+
+        /* doesn't fit even into empty buffer, skip the copy */
+        if( length > TERMCO_SINK_SIZE ) {
+            __termco_sink_emit( sink, data, length );
+            return;
+        }
+    }
+
+    memcpy( sink->buffer + sink->length, data, length );
+    sink->length += length;
+}
+
+void termco_sink_puts( termco_sink* sink, const char* str ) {
+    termco_sink_write( sink, str, strlen( str ) );
+}
+
+#else
+
+void termco_sink_init( termco_sink* sink, int fd );
+int termco_sink_flush( termco_sink* sink );
+void termco_sink_write( termco_sink* sink, const char* data, size_t length );
+void termco_sink_puts( termco_sink* sink, const char* str );
+
+#endif
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
 
+#if defined(__cplusplus) && defined(TERMCO_LIVE)
+
+#ifndef __TERMCO_LIVE
+#define __TERMCO_LIVE
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string>
+#include <memory>
+
+#ifdef __TERMCO_WINDOWS
+#include <io.h>
+#define __TERMCO_ISATTY(file) _isatty( _fileno( file ) )
+#else
+#include <unistd.h>
+#define __TERMCO_ISATTY(file) isatty( fileno( file ) )
+#endif
+
+#define __TERMCO_ANSI_CURSOR_UP "\x1b[%dA"
+#define __TERMCO_ANSI_CLEAR_LINE "\r\x1b[2K"
+#define __TERMCO_LIVE_LABEL 48
+
+class TermcoRegion {
+
+    public:
+        TermcoRegion( int lines, int rate = 20, int bar = 30, FILE* out = stdout );
+        ~TermcoRegion();
+
+        void label( int line, const char* text );
+        void update( int line, uint64_t done, uint64_t total );
+        void advance( int line, uint64_t delta = 1 );
+
+        void start();
+        void stop();
+
+    private:
+        struct Line {
+            std::atomic<uint64_t> done {0};
+            std::atomic<uint64_t> total {0};
+            std::atomic<unsigned> sequence {0};
+            std::atomic<char> label[__TERMCO_LIVE_LABEL];
+
+            // only touched by the render thread
+            char cached[__TERMCO_LIVE_LABEL] = {0};
+            uint64_t shown = (uint64_t) -1;
+
+            // keep counters of neighbouring lines on separate cache lines
+            char padding[64];
+        };
+
+        void run();
+        void draw( bool force );
+
+        static uint64_t key( uint64_t done, uint64_t total, unsigned sequence ) {
+            return done ^ (total << 24) ^ ((uint64_t) sequence << 48);
+        }
+
+        std::unique_ptr<Line[]> lines;
+        std::string buffer;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool running = false;
+        bool drawn = false;
+        bool live;
+        int count, bar;
+        std::chrono::milliseconds interval;
+        FILE* out;
+
+};
+
+#endif
+
+#ifdef TERMCO_IMPLEMENTATION
+
+TermcoRegion::TermcoRegion( int lines, int rate, int bar, FILE* out )
+: lines( new Line[lines] ), live( __TERMCO_ISATTY( out ) ), count( lines ), bar( bar ), interval( 1000 / (rate < 1 ? 1 : rate > 1000 ? 1000 : rate) ), out( out ) {
+    for( int i = 0; i < lines; i ++ ) {
+        for( auto& c : this->lines[i].label ) c.store( 0, std::memory_order_relaxed );
+    }
+}
+
+TermcoRegion::~TermcoRegion() {
+    this->stop();
+}
+
+void TermcoRegion::label( int line, const char* text ) {
+    Line& entry = this->lines[line];
+
+    // seqlock, the render thread skips the label while it is odd
+    entry.sequence.fetch_add( 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    for( int i = 0; i < __TERMCO_LIVE_LABEL - 1; i ++ ) {
+        entry.label[i].store( *text, std::memory_order_relaxed );
+        if( *text ) text ++;
+    }
+    entry.sequence.fetch_add( 1, std::memory_order_release );
+}
+
+void TermcoRegion::update( int line, uint64_t done, uint64_t total ) {
+    this->lines[line].total.store( total, std::memory_order_relaxed );
+    this->lines[line].done.store( done, std::memory_order_relaxed );
+}
+
+void TermcoRegion::advance( int line, uint64_t delta ) {
+    this->lines[line].done.fetch_add( delta, std::memory_order_relaxed );
+}
+
+void TermcoRegion::start() {
+    std::lock_guard<std::mutex> lock( this->mutex );
+
+    if( !this->running ) {
+        this->running = true;
+        this->thread = std::thread( &TermcoRegion::run, this );
+    }
+}
+
+void TermcoRegion::stop() {
+    {
+        std::lock_guard<std::mutex> lock( this->mutex );
+        if( !this->running ) return;
+        this->running = false;
+    }
+
+    this->condition.notify_all();
+    this->thread.join();
+
+    // make sure the final state is visible
+    this->draw( true );
+}
+
+void TermcoRegion::run() {
+    std::unique_lock<std::mutex> lock( this->mutex );
+
+    while( this->running ) {
+        lock.unlock();
+        this->draw( false );
+        lock.lock();
+
+        this->condition.wait_for( lock, this->interval, [this] { return !this->running; } );
+    }
+}
+
+void TermcoRegion::draw( bool force ) {
+    char number[64];
+    bool dirty = force || !this->drawn;
+
+    // don't spam redirected output with frames, only the final one is drawn
+    if( !force && !this->live ) return;
+
+    for( int i = 0; i < this->count && !dirty; i ++ ) {
+        Line& entry = this->lines[i];
+        dirty = entry.shown != this->key( entry.done.load( std::memory_order_relaxed ), entry.total.load( std::memory_order_relaxed ), entry.sequence.load( std::memory_order_relaxed ) );
+    }
+
+    if( !dirty ) return;
+
+    this->buffer.clear();
+
+    // redirected output gets plain lines, every final state is appended
+    if( this->drawn && this->live ) {
+        snprintf( number, sizeof(number), __TERMCO_ANSI_CURSOR_UP, this->count );
+        this->buffer += number;
+    }
+
+    for( int i = 0; i < this->count; i ++ ) {
+        Line& entry = this->lines[i];
+        char label[__TERMCO_LIVE_LABEL];
+        unsigned sequence = entry.sequence.load( std::memory_order_acquire );
+
+        for( int j = 0; j < __TERMCO_LIVE_LABEL; j ++ ) {
+            label[j] = entry.label[j].load( std::memory_order_relaxed );
+        }
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+
+        // label is being written right now, keep the last good one on screen and retry next frame
+        if( !(sequence & 1) && sequence == entry.sequence.load( std::memory_order_relaxed ) ) {
+            memcpy( entry.cached, label, sizeof(label) );
+        }
+
+        uint64_t done = entry.done.load( std::memory_order_relaxed );
+        uint64_t total = entry.total.load( std::memory_order_relaxed );
+        double progress = total ? (double) (done < total ? done : total) / total : 0;
+        int filled = (int) (progress * this->bar + 0.5);
+
+        entry.shown = this->key( done, total, sequence );
+
+        if( this->live ) this->buffer += __TERMCO_ANSI_CLEAR_LINE;
+        this->buffer += entry.cached;
+        this->buffer += " [";
+        this->buffer.append( filled, '#' );
+        this->buffer.append( this->bar - filled, '-' );
+        snprintf( number, sizeof(number), "] %3d%% (%llu/%llu)\n", (int) (progress * 100), (unsigned long long) done, (unsigned long long) total );
+        this->buffer += number;
+    }
+
+    this->drawn = true;
+    fwrite( this->buffer.data(), 1, this->buffer.size(), this->out );
+    fflush( this->out );
+}
+
+#endif
+
+#endif
+
+#if defined(TERMCO_BENCHMARK) && defined(TERMCO_IMPLEMENTATION)
+
+#ifndef TERMCO_SINK
+#error "TERMCO_BENCHMARK requires TERMCO_SINK!"
+#endif
+
+#ifdef TERMCO_NONE
+#error "TERMCO_BENCHMARK requires TERMCO_AUTO_ANSI, TERMCO_WIN_ANSI or TERMCO_STD_ANSI!"
+#endif
+
+#ifdef __TERMCO_WINDOWS
+#error "TERMCO_BENCHMARK is not supported on Windows!"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define __TERMCO_BENCH_WIDTH 10
+#define __TERMCO_BENCH_NAIVE 0
+#define __TERMCO_BENCH_BUFFERED 1
+#define __TERMCO_BENCH_DIFFED 2
+
+typedef struct {
+    char text[__TERMCO_BENCH_WIDTH + 1];
+    int color;
+} __termco_bench_cell;
+
+typedef struct {
+    const char* name;
+    int rows, columns, frames;
+
+    /* frames are drawn over each other instead of being appended */
+    int overwrite;
+
+    /* mutates cells in place, unchanged cells must be left untouched */
+    void (*fill)( __termco_bench_cell* cells, int frame, unsigned* seed );
+} __termco_bench_workload;
+
+static const char* __termco_bench_colors[] = {
+    F_RESET, F_GRAY, F_RED, F_GREEN, F_YELLOW, F_BLUE, F_CYAN, F_L_RED, F_L_GREEN
+};
+
+static unsigned __termco_bench_random( unsigned* seed ) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static void __termco_bench_set( __termco_bench_cell* cell, int color, const char* text ) {
+    snprintf( cell->text, sizeof(cell->text), "%-*.*s", __TERMCO_BENCH_WIDTH, __TERMCO_BENCH_WIDTH, text );
+    cell->color = color;
+}
+
+/* timestamp, level, module and message, one line per frame */
+static void __termco_bench_logs( __termco_bench_cell* cells, int frame, unsigned* seed ) {
+    static const char* levels[3] = { "INFO", "WARN", "ERROR" };
+    static const char* modules[4] = { "net", "disk", "auth", "cache" };
+    unsigned level = __termco_bench_random( seed ) % 16;
+    char text[32];
+
+    level = level < 12 ? 0 : level < 15 ? 1 : 2;
+    snprintf( text, sizeof(text), "%02d:%02d.%03d", (frame / 60000) % 60, (frame / 1000) % 60, frame % 1000 );
+
+    __termco_bench_set( cells + 0, 1, text );
+    __termco_bench_set( cells + 1, level == 0 ? 3 : level == 1 ? 4 : 2, levels[level] );
+    __termco_bench_set( cells + 2, 5, modules[__termco_bench_random( seed ) % 4] );
+    snprintf( text, sizeof(text), "event %u", __termco_bench_random( seed ) % 100000 );
+    __termco_bench_set( cells + 3, 0, text );
+}
+
+/* grid of gauges, about one in ten changes between frames */
+static void __termco_bench_dashboard( __termco_bench_cell* cells, int frame, unsigned* seed ) {
+    char text[32];
+    int i;
+
+    for( i = 0; i < 16 * 8; i ++ ) {
+        if( frame == 0 || __termco_bench_random( seed ) % 10 == 0 ) {
+            unsigned value = __termco_bench_random( seed ) % 100;
+            snprintf( text, sizeof(text), "%3u%%", value );
+            __termco_bench_set( cells + i, value < 50 ? 3 : value < 80 ? 4 : 2, text );
+        }
+    }
+}
+
+/* id, name, quantity, price, change and status, one row per frame */
+static void __termco_bench_table( __termco_bench_cell* cells, int frame, unsigned* seed ) {
+    static const char* names[4] = { "alpha", "beta", "gamma", "delta" };
+    int change = (int) (__termco_bench_random( seed ) % 2001) - 1000;
+    char text[32];
+
+    snprintf( text, sizeof(text), "%d", frame );
+    __termco_bench_set( cells + 0, 1, text );
+    __termco_bench_set( cells + 1, 6, names[frame % 4] );
+    snprintf( text, sizeof(text), "%u", __termco_bench_random( seed ) % 1000 );
+    __termco_bench_set( cells + 2, 0, text );
+    snprintf( text, sizeof(text), "%u.%02u", __termco_bench_random( seed ) % 500, __termco_bench_random( seed ) % 100 );
+    __termco_bench_set( cells + 3, 0, text );
+    snprintf( text, sizeof(text), "%+d.%d%%", change / 10, abs( change % 10 ) );
+    __termco_bench_set( cells + 4, change < 0 ? 7 : 8, text );
+    __termco_bench_set( cells + 5, change < 0 ? 4 : 3, change < 0 ? "sell" : "hold" );
+}
+
+static void __termco_bench_emit( termco_sink* sink, const char* data, size_t length, int strategy ) {
+    termco_sink_write( sink, data, length );
+
+    /* naive output issues one write() per fragment, like unbuffered stdio */
+    if( strategy == __TERMCO_BENCH_NAIVE ) termco_sink_flush( sink );
+}
+
+/* returns elapsed nanoseconds, byte and write counts are left in the sink */
+static double __termco_bench_render( const __termco_bench_workload* workload, int strategy, termco_sink* sink ) {
+    size_t count = (size_t) workload->rows * workload->columns;
+    __termco_bench_cell* cells = (__termco_bench_cell*) calloc( count, sizeof(__termco_bench_cell) );
+    __termco_bench_cell* previous = (__termco_bench_cell*) calloc( count, sizeof(__termco_bench_cell) );
+    unsigned seed = 0x9e3779b9u;
+    int frame, row, column, pen = -1, cursor = -1;
+    struct timespec start, end;
+    char move[32];
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    for( frame = 0; frame < workload->frames; frame ++ ) {
+        memcpy( previous, cells, count * sizeof(__termco_bench_cell) );
+        workload->fill( cells, frame, &seed );
+
+        if( workload->overwrite && strategy != __TERMCO_BENCH_DIFFED ) {
+            __termco_bench_emit( sink, "\x1b[H", 3, strategy );
+        }
+
+        for( row = 0; row < workload->rows; row ++ ) {
+            for( column = 0; column < workload->columns; column ++ ) {
+                int index = row * workload->columns + column;
+                const __termco_bench_cell* cell = cells + index;
+
+                if( strategy != __TERMCO_BENCH_DIFFED ) {
+                    const char* color = __termco_bench_colors[cell->color];
+                    __termco_bench_emit( sink, color, strlen( color ), strategy );
+                    __termco_bench_emit( sink, cell->text, __TERMCO_BENCH_WIDTH, strategy );
+                    __termco_bench_emit( sink, S_RESET, sizeof(S_RESET) - 1, strategy );
+                    continue;
+                }
+
+                /* only changed cells are drawn, the cursor and color are moved only when needed */
+                if( workload->overwrite ) {
+                    if( frame > 0 && memcmp( cell, previous + index, sizeof(__termco_bench_cell) ) == 0 ) continue;
+
+                    if( cursor != index ) {
+                        int length = snprintf( move, sizeof(move), "\x1b[%d;%dH", row + 1, column * __TERMCO_BENCH_WIDTH + 1 );
+                        __termco_bench_emit( sink, move, (size_t) length, strategy );
+                    }
+
+                    cursor = index + 1;
+                }
+
+                if( cell->color != pen ) {
+                    const char* color = __termco_bench_colors[cell->color];
+                    __termco_bench_emit( sink, color, strlen( color ), strategy );
+                    pen = cell->color;
+                }
+
+                __termco_bench_emit( sink, cell->text, __TERMCO_BENCH_WIDTH, strategy );
+            }
+
+            if( !workload->overwrite || strategy != __TERMCO_BENCH_DIFFED ) {
+                __termco_bench_emit( sink, "\n", 1, strategy );
+            }
+        }
+    }
+
+    if( strategy == __TERMCO_BENCH_DIFFED ) __termco_bench_emit( sink, S_RESET, sizeof(S_RESET) - 1, strategy );
+    termco_sink_flush( sink );
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    free( cells );
+    free( previous );
+    return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+}
+
+/* opens a pseudo terminal and drains its master side in a child process */
+static int __termco_bench_pty( pid_t* child ) {
+    int master = posix_openpt( O_RDWR | O_NOCTTY ), slave;
+    char buffer[65536];
+
+    if( master < 0 || grantpt( master ) != 0 || unlockpt( master ) != 0 ) return -1;
+    if( (slave = open( ptsname( master ), O_WRONLY | O_NOCTTY )) < 0 ) return -1;
+
+    if( (*child = fork()) == 0 ) {
+        close( slave );
+        while( read( master, buffer, sizeof(buffer) ) > 0 );
+        _exit( 0 );
+    }
+
+    close( master );
+    return slave;
+}
+
+int main( int argc, char** argv ) {
+    static const __termco_bench_workload workloads[3] = {
+        { "logs", 1, 4, 20000, 0, __termco_bench_logs },
+        { "dashboard", 16, 8, 1000, 1, __termco_bench_dashboard },
+        { "table", 1, 6, 10000, 0, __termco_bench_table }
+    };
+
+    static const char* strategies[3] = { "naive", "buffered", "diffed" };
+    const char* target = argc > 1 ? argv[1] : "/dev/null";
+    static termco_sink sink;
+    pid_t child = -1;
+    int fd, i, j, status = 0;
+
+    fd = strcmp( target, "pty" ) == 0 ? __termco_bench_pty( &child ) : open( target, O_WRONLY );
+
+    if( fd < 0 ) {
+        fprintf( stderr, "Failed to open '%s'\n", target );
+        return 1;
+    }
+
+    printf( "%-10s %-9s %12s %9s %9s\n", "workload", "strategy", "bytes", "writes", "ns/cell" );
+
+    for( i = 0; i < 3; i ++ ) {
+        double cells = (double) workloads[i].rows * workloads[i].columns * workloads[i].frames;
+
+        for( j = 0; j < 3; j ++ ) {
+            double elapsed;
+
+            termco_sink_init( &sink, fd );
+            elapsed = __termco_bench_render( workloads + i, j, &sink );
+
+            if( sink.error ) {
+                fprintf( stderr, "Write to '%s' failed: %s\n", target, strerror( sink.error ) );
+                status = 1;
+            }
+
+            printf( "%-10s %-9s %12llu %9llu %9.1f\n", workloads[i].name, strategies[j], sink.bytes, sink.writes, elapsed / cells );
+        }
+    }
+
+    close( fd );
+    if( child > 0 ) waitpid( child, NULL, 0 );
+    return status;
+}
+
+#endif
+
 #endif /* TERMCO_H */
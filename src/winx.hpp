@@ -27,6 +27,7 @@
 #define WINX_HPP_
 
 #include <stdexcept>
+#include <vector>
 
 #ifdef WINX_WINAPI
 #include <windows.h>
@@ -35,11 +36,75 @@
 
 #ifdef WINX_X11
 #include <X11/Xlib.h>
+#include <poll.h>
+#endif
+
+// software framebuffer, X11 only, link with -lXext
+// define WINX_FRAMEBUFFER_TEST (with WINX_IMPLEMENT) to get a main() that draws a few
+// frames, reads the window back and exits with a non zero code if anything differs:
+//   g++ -x c++ -DWINX_X11 -DWINX_FRAMEBUFFER -DWINX_IMPLEMENT -DWINX_FRAMEBUFFER_TEST winx.hpp -o test -lX11 -lXext
+//   xvfb-run -s "-screen 0 640x480x24" ./test
+#if defined(WINX_X11) && defined(WINX_FRAMEBUFFER)
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #endif
 
 class WinxWindow;
 class WinxException;
 struct WinxWindowState;
+class WinxFramebuffer;
+
+enum WinxEventType {
+	WINX_KEY_PRESS,
+	WINX_KEY_RELEASE,
+	WINX_BUTTON_PRESS,
+	WINX_BUTTON_RELEASE,
+	WINX_MOTION,
+	WINX_ENTER,
+	WINX_LEAVE,
+	WINX_FOCUS_IN,
+	WINX_FOCUS_OUT,
+	WINX_EXPOSE,
+	WINX_RESIZE
+};
+
+#define WINX_SHIFT 1
+#define WINX_CONTROL 2
+#define WINX_ALT 4
+
+// code is a KeySym (X11) or virtual key (WinAPI) for keys and 1-5 for
+// buttons (left, middle, right, wheel up, wheel down), width and height are
+// only used by expose and resize events
+struct WinxEvent {
+
+	WinxEventType type;
+	int x, y;
+	int width, height;
+	unsigned code;
+	unsigned modifiers;
+
+};
+
+typedef void (*WinxHandler) (const WinxEvent* events, int count, WinxWindow& ww);
+
+// events gathered during one tick, motion is merged with the motion right before it,
+// exposed areas are joined into one rectangle and only the last size is kept,
+// both are sent at the end of the batch
+struct WinxBatch {
+
+	WinxHandler handler = nullptr;
+	std::vector<WinxEvent> events;
+	bool exposed = false;
+	int left, top, right, bottom;
+	bool resized = false;
+	int width = -1, height = -1;
+
+};
 
 #ifdef WINX_X11
 typedef void (*WinxCallback) (XEvent evt, WinxWindow& ww);
@@ -50,6 +115,10 @@ struct WinxWindowState {
 	Window window;
 	int con;
 
+	// receives MIT-SHM completion events before they reach the callback or the batch,
+	// always present so that the layout doesn't depend on WINX_FRAMEBUFFER
+	WinxFramebuffer* framebuffer;
+
 };
 #endif
 
@@ -93,6 +162,9 @@ class WinxWindow {
 		void setTitle( const char* title );
 		WinxWindowState& getState();
 		bool tick();
+		bool poll();
+		bool waitFor( int milliseconds );
+		void setHandler( WinxHandler handler );
 
 #ifdef WINX_X11
 		WinxWindow( int x, int y, int w, int h, WinxCallback callback = [] (XEvent evt, WinxWindow& ww) {} );
@@ -104,9 +176,82 @@ class WinxWindow {
 
 	private:
 		WinxWindowState state;
+		WinxBatch batch;
+
+		void collect( const WinxEvent& event );
+		void dispatch();
+
+#ifdef WINX_X11
+		void handle( XEvent& event );
+#endif
+
+#ifdef WINX_WINAPI
+		void handle( MSG& msg );
+#endif
 
 };
 
+#if defined(WINX_X11) && defined(WINX_FRAMEBUFFER)
+/// CPU framebuffer presented to a window ///
+// pixels are 0x00RRGGBB, drawing goes to the back buffer returned by getPixels(),
+// present() shows the damaged areas and swaps buffers, the new back buffer
+// already contains the presented frame; uses MIT-SHM when the server supports it.
+// The presented areas are copied into the new back buffer on the next getPixels()
+// or present(), so every present() costs one copy of its damage, damage() only what
+// changed to keep it small. A shared buffer is reused once the server reports that it
+// finished reading it, that report comes with the window events so keep calling
+// tick(), poll() or waitFor(), otherwise getPixels() blocks until it arrives.
+// Only one framebuffer can be attached to a window.
+class WinxFramebuffer {
+
+	public:
+		WinxFramebuffer( WinxWindow& window, int width, int height );
+		WinxFramebuffer( const WinxFramebuffer& framebuffer ) = delete;
+		WinxFramebuffer& operator=( const WinxFramebuffer& framebuffer ) = delete;
+		~WinxFramebuffer();
+
+		uint32_t* getPixels();
+		int getWidth();
+		int getHeight();
+		int getStride();
+		bool isShared();
+
+		void damage( int x, int y, int w, int h );
+		void present();
+		void resize( int width, int height );
+
+	private:
+		friend class WinxWindow;
+
+		struct Buffer {
+			XImage* image;
+			XShmSegmentInfo info;
+			bool pending;
+			std::vector<XRectangle> stale;
+		};
+
+		WinxWindowState& state;
+		GC gc;
+		Visual* visual;
+		int depth;
+		bool shared;
+		int completion;
+		int width, height;
+		int back;
+		Buffer buffers[2];
+		std::vector<XRectangle> damaged;
+
+		void create();
+		void destroy();
+		void wait( Buffer& buffer );
+		void update();
+		bool complete( const XEvent& event );
+
+		static Bool match( Display* display, XEvent* event, XPointer framebuffer );
+
+};
+#endif
+
 #ifdef WINX_IMPLEMENT
 
 #ifdef WINX_WINAPI
@@ -150,13 +295,15 @@ WinxWindow::WinxWindow( int x, int y, int w, int h, WinxCallback callback ) {
 				LeaveWindowMask |
 				PointerMotionMask |
 				FocusChangeMask |
-				ExposureMask
+				ExposureMask |
+				StructureNotifyMask
 			);
 
 	// map (show) the window
 	XMapWindow(state.display, state.window);
 
 	state.callback = callback;
+	state.framebuffer = nullptr;
 
 }
 #endif
@@ -241,30 +388,697 @@ WinxWindowState& WinxWindow::getState() {
 	return this->state;
 }
 
+/// Set batched event handler, replaces the raw callback ///
+void WinxWindow::setHandler( WinxHandler handler ) {
+	this->batch.handler = handler;
+}
+
+/// Add decoded event to the current batch ///
+void WinxWindow::collect( const WinxEvent& event ) {
+	std::vector<WinxEvent>& events = this->batch.events;
+
+	switch( event.type ) {
+
+		case WINX_MOTION:
+			if( !events.empty() && events.back().type == WINX_MOTION ) {
+				events.back() = event;
+				return;
+			}
+			break;
+
+		case WINX_EXPOSE:
+			if( !this->batch.exposed ) {
+				this->batch.exposed = true;
+				this->batch.left = event.x;
+				this->batch.top = event.y;
+				this->batch.right = event.x + event.width;
+				this->batch.bottom = event.y + event.height;
+			}else{
+				if( event.x < this->batch.left ) this->batch.left = event.x;
+				if( event.y < this->batch.top ) this->batch.top = event.y;
+				if( event.x + event.width > this->batch.right ) this->batch.right = event.x + event.width;
+				if( event.y + event.height > this->batch.bottom ) this->batch.bottom = event.y + event.height;
+			}
+			return;
+
+		case WINX_RESIZE:
+			if( event.width != this->batch.width || event.height != this->batch.height ) {
+				this->batch.resized = true;
+				this->batch.width = event.width;
+				this->batch.height = event.height;
+			}
+			return;
+
+		default:
+			break;
+
+	}
+
+	events.push_back( event );
+}
+
+/// Send collected events to the handler ///
+void WinxWindow::dispatch() {
+	std::vector<WinxEvent>& events = this->batch.events;
+
+#ifdef WINX_WINAPI
+	// WM_SIZE is sent directly to the window procedure, check the size instead
+	RECT rect;
+
+	if( GetClientRect( this->state.hwnd, &rect ) ) {
+		this->collect( { WINX_RESIZE, 0, 0, rect.right - rect.left, rect.bottom - rect.top, 0, 0 } );
+	}
+#endif
+
+	if( this->batch.resized ) {
+		events.push_back( { WINX_RESIZE, 0, 0, this->batch.width, this->batch.height, 0, 0 } );
+		this->batch.resized = false;
+	}
+
+	if( this->batch.exposed ) {
+		events.push_back( { WINX_EXPOSE, this->batch.left, this->batch.top, this->batch.right - this->batch.left, this->batch.bottom - this->batch.top, 0, 0 } );
+		this->batch.exposed = false;
+	}
+
+	if( !events.empty() ) {
+		this->batch.handler( events.data(), (int) events.size(), *this );
+		events.clear();
+	}
+}
+
 
 #ifdef WINX_X11
+/// Decode event into the batch or pass it to the raw callback ///
+void WinxWindow::handle( XEvent& event ) {
+
+#ifdef WINX_FRAMEBUFFER
+	if( this->state.framebuffer && this->state.framebuffer->complete( event ) ) return;
+#endif
+
+	if( !this->batch.handler ) {
+		this->state.callback(event, *this);
+		return;
+	}
+
+	WinxEvent decoded = {};
+
+	switch( event.type ) {
+
+		case KeyPress:
+		case KeyRelease:
+			decoded.type = event.type == KeyPress ? WINX_KEY_PRESS : WINX_KEY_RELEASE;
+			decoded.x = event.xkey.x;
+			decoded.y = event.xkey.y;
+			decoded.code = XLookupKeysym( &event.xkey, 0 );
+			decoded.modifiers = event.xkey.state;
+			break;
+
+		case ButtonPress:
+		case ButtonRelease:
+			decoded.type = event.type == ButtonPress ? WINX_BUTTON_PRESS : WINX_BUTTON_RELEASE;
+			decoded.x = event.xbutton.x;
+			decoded.y = event.xbutton.y;
+			decoded.code = event.xbutton.button;
+			decoded.modifiers = event.xbutton.state;
+			break;
+
+		case MotionNotify:
+			decoded.type = WINX_MOTION;
+			decoded.x = event.xmotion.x;
+			decoded.y = event.xmotion.y;
+			decoded.modifiers = event.xmotion.state;
+			break;
+
+		case EnterNotify:
+		case LeaveNotify:
+			decoded.type = event.type == EnterNotify ? WINX_ENTER : WINX_LEAVE;
+			decoded.x = event.xcrossing.x;
+			decoded.y = event.xcrossing.y;
+			decoded.modifiers = event.xcrossing.state;
+			break;
+
+		case FocusIn:
+		case FocusOut:
+			decoded.type = event.type == FocusIn ? WINX_FOCUS_IN : WINX_FOCUS_OUT;
+			break;
+
+		case Expose:
+			decoded.type = WINX_EXPOSE;
+			decoded.x = event.xexpose.x;
+			decoded.y = event.xexpose.y;
+			decoded.width = event.xexpose.width;
+			decoded.height = event.xexpose.height;
+			break;
+
+		case ConfigureNotify:
+			decoded.type = WINX_RESIZE;
+			decoded.width = event.xconfigure.width;
+			decoded.height = event.xconfigure.height;
+			break;
+
+		default:
+			return;
+
+	}
+
+	// X11 state mask to winx modifiers
+	unsigned mask = decoded.modifiers;
+	decoded.modifiers = (mask & ShiftMask ? WINX_SHIFT : 0) | (mask & ControlMask ? WINX_CONTROL : 0) | (mask & Mod1Mask ? WINX_ALT : 0);
+
+	this->collect( decoded );
+}
+
 bool WinxWindow::tick() {
 
 	XEvent event;
 	XNextEvent(this->state.display, &event);
-	this->state.callback(event, *this);
+	this->handle(event);
+
+	// take everything that already arrived, so the batch can merge it
+	if( this->batch.handler ) {
+		while( XEventsQueued( this->state.display, QueuedAlready ) > 0 ) {
+			XNextEvent( this->state.display, &event );
+			this->handle( event );
+		}
+
+		this->dispatch();
+	}
 
 	return true;
 }
+
+/// Handle all pending events without blocking ///
+bool WinxWindow::poll() {
+
+	// only take what is already queued, events that arrive
+	// while the callback runs are left for the next call
+	int count = XEventsQueued( this->state.display, QueuedAfterFlush );
+	XEvent event;
+
+	// the callback can take events out of the queue (for example a framebuffer waiting
+	// for its buffer), so check that the event is still there before reading it
+	while( count -- > 0 && XEventsQueued( this->state.display, QueuedAlready ) > 0 ) {
+		XNextEvent( this->state.display, &event );
+		this->handle( event );
+	}
+
+	if( this->batch.handler ) this->dispatch();
+	return true;
+}
+
+/// Wait up to given time for events (forever if negative) and handle them ///
+bool WinxWindow::waitFor( int milliseconds ) {
+
+	if( XEventsQueued( this->state.display, QueuedAfterFlush ) == 0 ) {
+		pollfd fd = { ConnectionNumber( this->state.display ), POLLIN, 0 };
+		::poll( &fd, 1, milliseconds < 0 ? -1 : milliseconds );
+	}
+
+	return this->poll();
+}
 #endif
 
 #ifdef WINX_WINAPI
+/// Decode message into the batch, messages are still dispatched as usual ///
+void WinxWindow::handle( MSG& msg ) {
+
+	if( !this->batch.handler || msg.hwnd != this->state.hwnd ) return;
+
+	WinxEvent decoded = {};
+	decoded.x = (short) LOWORD(msg.lParam);
+	decoded.y = (short) HIWORD(msg.lParam);
+
+	switch( msg.message ) {
+
+		case WM_KEYDOWN: case WM_SYSKEYDOWN: decoded.type = WINX_KEY_PRESS; decoded.code = (unsigned) msg.wParam; decoded.x = decoded.y = 0; break;
+		case WM_KEYUP: case WM_SYSKEYUP: decoded.type = WINX_KEY_RELEASE; decoded.code = (unsigned) msg.wParam; decoded.x = decoded.y = 0; break;
+		case WM_LBUTTONDOWN: decoded.type = WINX_BUTTON_PRESS; decoded.code = 1; break;
+		case WM_MBUTTONDOWN: decoded.type = WINX_BUTTON_PRESS; decoded.code = 2; break;
+		case WM_RBUTTONDOWN: decoded.type = WINX_BUTTON_PRESS; decoded.code = 3; break;
+		case WM_LBUTTONUP: decoded.type = WINX_BUTTON_RELEASE; decoded.code = 1; break;
+		case WM_MBUTTONUP: decoded.type = WINX_BUTTON_RELEASE; decoded.code = 2; break;
+		case WM_RBUTTONUP: decoded.type = WINX_BUTTON_RELEASE; decoded.code = 3; break;
+		case WM_MOUSEMOVE: decoded.type = WINX_MOTION; break;
+
+		case WM_MOUSEWHEEL: {
+			// wheel position is in screen coordinates
+			POINT point = { decoded.x, decoded.y };
+			ScreenToClient( this->state.hwnd, &point );
+
+			decoded.type = WINX_BUTTON_PRESS;
+			decoded.code = GET_WHEEL_DELTA_WPARAM(msg.wParam) > 0 ? 4 : 5;
+			decoded.x = point.x;
+			decoded.y = point.y;
+			break;
+		}
+
+		case WM_PAINT: {
+			RECT rect;
+			if( !GetUpdateRect( this->state.hwnd, &rect, FALSE ) ) return;
+
+			decoded.type = WINX_EXPOSE;
+			decoded.x = rect.left;
+			decoded.y = rect.top;
+			decoded.width = rect.right - rect.left;
+			decoded.height = rect.bottom - rect.top;
+			break;
+		}
+
+		default:
+			return;
+
+	}
+
+	decoded.modifiers = (GetKeyState(VK_SHIFT) < 0 ? WINX_SHIFT : 0) | (GetKeyState(VK_CONTROL) < 0 ? WINX_CONTROL : 0) | (GetKeyState(VK_MENU) < 0 ? WINX_ALT : 0);
+	this->collect( decoded );
+}
+
 bool WinxWindow::tick() {
 	MSG msg;
 
 	if( GetMessage(&msg, NULL, 0, 0) > 0) {
+		this->handle(msg);
 		TranslateMessage(&msg);
 	    DispatchMessage(&msg);
+
+		// take everything that already arrived, so the batch can merge it
+		if( this->batch.handler ) {
+			bool quit = false;
+
+			while( PeekMessage(&msg, NULL, 0, 0, PM_REMOVE) ) {
+				quit = msg.message == WM_QUIT;
+				if( quit ) break;
+
+				this->handle(msg);
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+
+			this->dispatch();
+			return !quit;
+		}
+
 	    return true;
 	}
 
 	return false;
 }
+
+/// Handle all pending events without blocking ///
+bool WinxWindow::poll() {
+	MSG msg;
+
+	while( PeekMessage(&msg, NULL, 0, 0, PM_REMOVE) ) {
+		if( msg.message == WM_QUIT ) return false;
+
+		this->handle(msg);
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+
+	if( this->batch.handler ) this->dispatch();
+	return true;
+}
+
+/// Wait up to given time for events (forever if negative) and handle them ///
+bool WinxWindow::waitFor( int milliseconds ) {
+	MsgWaitForMultipleObjects( 0, NULL, FALSE, milliseconds < 0 ? INFINITE : milliseconds, QS_ALLINPUT );
+	return this->poll();
+}
+#endif
+
+#if defined(WINX_X11) && defined(WINX_FRAMEBUFFER)
+static bool _winx_shm_failed;
+
+static int _WinxShmErrorHandler( Display*, XErrorEvent* ) {
+	_winx_shm_failed = true;
+	return 0;
+}
+
+/// Framebuffer constructor ///
+WinxFramebuffer::WinxFramebuffer( WinxWindow& window, int width, int height ) : state( window.getState() ) {
+
+	this->visual = DefaultVisual( state.display, state.con );
+	this->depth = DefaultDepth( state.display, state.con );
+
+	if( this->visual->c_class != TrueColor || (this->depth != 24 && this->depth != 32) ) {
+		WINX_FAIL( "Unsupported visual, framebuffer needs 24 bit TrueColor" );
+	}
+
+	if( state.framebuffer ) WINX_FAIL( "Window already has a framebuffer" );
+
+	// shared memory only works with a local server
+	this->shared = XShmQueryExtension( state.display );
+	this->completion = this->shared ? XShmGetEventBase( state.display ) + ShmCompletion : -1;
+	this->gc = XCreateGC( state.display, state.window, 0, NULL );
+	this->width = width;
+	this->height = height;
+
+	this->create();
+	state.framebuffer = this;
+
+}
+
+/// Framebuffer destructor ///
+WinxFramebuffer::~WinxFramebuffer() {
+	this->destroy();
+	XFreeGC( state.display, this->gc );
+	state.framebuffer = nullptr;
+}
+
+/// Create both buffers, falls back to XPutImage if shared memory can't be used ///
+void WinxFramebuffer::create() {
+
+	this->back = 0;
+	this->damaged.clear();
+
+	for( Buffer& buffer : this->buffers ) {
+		buffer.image = nullptr;
+		buffer.pending = false;
+		buffer.info.shmaddr = nullptr;
+		buffer.stale.clear();
+	}
+
+	for( Buffer& buffer : this->buffers ) {
+		if( this->shared ) {
+			buffer.image = XShmCreateImage( state.display, this->visual, this->depth, ZPixmap, NULL, &buffer.info, this->width, this->height );
+
+			if( buffer.image ) {
+				buffer.info.shmid = shmget( IPC_PRIVATE, buffer.image->bytes_per_line * buffer.image->height, IPC_CREAT | 0600 );
+				buffer.info.shmaddr = buffer.info.shmid < 0 ? (char*) -1 : (char*) shmat( buffer.info.shmid, 0, 0 );
+				buffer.info.readOnly = False;
+
+				if( buffer.info.shmaddr != (char*) -1 ) {
+
+					// attaching fails asynchronously (for example on a remote server)
+					_winx_shm_failed = false;
+					XErrorHandler handler = XSetErrorHandler( _WinxShmErrorHandler );
+					XShmAttach( state.display, &buffer.info );
+					XSync( state.display, False );
+					XSetErrorHandler( handler );
+
+					// segment is freed once both sides detach
+					shmctl( buffer.info.shmid, IPC_RMID, 0 );
+
+					if( !_winx_shm_failed ) {
+						buffer.image->data = buffer.info.shmaddr;
+						continue;
+					}
+
+					shmdt( buffer.info.shmaddr );
+				}else if( buffer.info.shmid >= 0 ) {
+					shmctl( buffer.info.shmid, IPC_RMID, 0 );
+				}
+
+				buffer.info.shmaddr = nullptr;
+				XDestroyImage( buffer.image );
+				buffer.image = nullptr;
+			}
+
+			// first buffer may already be shared, start over without shared memory
+			this->shared = false;
+			this->destroy();
+			this->create();
+			return;
+		}
+
+		char* data = (char*) calloc( (size_t) this->width * this->height, 4 );
+		if( !data ) WINX_FAIL( "Unable to allocate framebuffer" );
+
+		buffer.image = XCreateImage( state.display, this->visual, this->depth, ZPixmap, 0, data, this->width, this->height, 32, 0 );
+		if( !buffer.image ) {
+			free( data );
+			WINX_FAIL( "Unable to create framebuffer image" );
+		}
+	}
+
+}
+
+/// Release both buffers ///
+void WinxFramebuffer::destroy() {
+
+	for( Buffer& buffer : this->buffers ) {
+		if( !buffer.image ) continue;
+
+		if( buffer.info.shmaddr ) {
+			this->wait( buffer );
+			XShmDetach( state.display, &buffer.info );
+			XDestroyImage( buffer.image );
+			shmdt( buffer.info.shmaddr );
+		}else{
+			XDestroyImage( buffer.image );
+		}
+
+		buffer.image = nullptr;
+		buffer.info.shmaddr = nullptr;
+	}
+
+	XSync( state.display, False );
+
+}
+
+/// Check if event is a completion of one of our buffers ///
+Bool WinxFramebuffer::match( Display*, XEvent* event, XPointer framebuffer ) {
+	WinxFramebuffer* self = (WinxFramebuffer*) framebuffer;
+	if( event->type != self->completion ) return False;
+
+	ShmSeg segment = ((XShmCompletionEvent*) event)->shmseg;
+
+	for( Buffer& buffer : self->buffers ) {
+		if( buffer.info.shmaddr && buffer.info.shmseg == segment ) return True;
+	}
+
+	return False;
+}
+
+/// Release the buffer a completion event refers to, returns false for other events ///
+bool WinxFramebuffer::complete( const XEvent& event ) {
+	if( !match( state.display, (XEvent*) &event, (XPointer) this ) ) return false;
+
+	for( Buffer& buffer : this->buffers ) {
+		if( buffer.info.shmaddr && buffer.info.shmseg == ((const XShmCompletionEvent&) event).shmseg ) buffer.pending = false;
+	}
+
+	return true;
+}
+
+/// Wait until the server no longer reads from the buffer ///
+void WinxFramebuffer::wait( Buffer& buffer ) {
+
+	// completions that were already read by the event loop have released the buffer,
+	// otherwise take them out of the queue, leaving every other event in place
+	while( buffer.pending ) {
+		XEvent event;
+		XIfEvent( state.display, &event, match, (XPointer) this );
+		this->complete( event );
+	}
+
+}
+
+/// Copy areas presented from the other buffer into the back buffer ///
+void WinxFramebuffer::update() {
+	Buffer& buffer = this->buffers[this->back];
+	Buffer& other = this->buffers[this->back ^ 1];
+	this->wait( buffer );
+
+	// the server only reads the other buffer, so it can be read here at the same time
+	const int stride = buffer.image->bytes_per_line;
+
+	for( XRectangle& rect : buffer.stale ) {
+		for( int row = rect.y; row < rect.y + rect.height; row ++ ) {
+			memcpy( buffer.image->data + row * stride + rect.x * 4, other.image->data + row * stride + rect.x * 4, rect.width * 4 );
+		}
+	}
+
+	buffer.stale.clear();
+}
+
+/// Get pixels of the back buffer ///
+uint32_t* WinxFramebuffer::getPixels() {
+	this->update();
+	return (uint32_t*) this->buffers[this->back].image->data;
+}
+
+/// Get framebuffer width ///
+int WinxFramebuffer::getWidth() {
+	return this->width;
+}
+
+/// Get framebuffer height ///
+int WinxFramebuffer::getHeight() {
+	return this->height;
+}
+
+/// Get number of pixels between the starts of two rows ///
+int WinxFramebuffer::getStride() {
+	return this->buffers[this->back].image->bytes_per_line / 4;
+}
+
+/// Check if frames are passed through shared memory ///
+bool WinxFramebuffer::isShared() {
+	return this->shared;
+}
+
+/// Mark area as changed, without any damage present() shows the whole frame ///
+void WinxFramebuffer::damage( int x, int y, int w, int h ) {
+
+	if( x < 0 ) { w += x; x = 0; }
+	if( y < 0 ) { h += y; y = 0; }
+	if( x + w > this->width ) w = this->width - x;
+	if( y + h > this->height ) h = this->height - y;
+	if( w <= 0 || h <= 0 ) return;
+
+	// too many small rectangles cost more than one bigger one
+	if( this->damaged.size() >= 16 ) {
+		XRectangle& box = this->damaged[0];
+		int left = box.x, top = box.y, right = box.x + box.width, bottom = box.y + box.height;
+
+		for( XRectangle& rect : this->damaged ) {
+			if( rect.x < left ) left = rect.x;
+			if( rect.y < top ) top = rect.y;
+			if( rect.x + rect.width > right ) right = rect.x + rect.width;
+			if( rect.y + rect.height > bottom ) bottom = rect.y + rect.height;
+		}
+
+		this->damaged.clear();
+		this->damaged.push_back( { (short) left, (short) top, (unsigned short) (right - left), (unsigned short) (bottom - top) } );
+	}
+
+	this->damaged.push_back( { (short) x, (short) y, (unsigned short) w, (unsigned short) h } );
+
+}
+
+/// Show damaged areas of the back buffer and swap buffers ///
+void WinxFramebuffer::present() {
+
+	if( this->damaged.empty() ) {
+		this->damaged.push_back( { 0, 0, (unsigned short) this->width, (unsigned short) this->height } );
+	}
+
+	// present() without getPixels() shows the same frame again
+	this->update();
+
+	Buffer& buffer = this->buffers[this->back];
+	Buffer& other = this->buffers[this->back ^ 1];
+
+	// requests are processed in order, so only the last one asks for a completion event
+	for( size_t i = 0; i < this->damaged.size(); i ++ ) {
+		XRectangle& rect = this->damaged[i];
+
+		if( this->shared ) {
+			XShmPutImage( state.display, state.window, this->gc, buffer.image, rect.x, rect.y, rect.x, rect.y, rect.width, rect.height, i + 1 == this->damaged.size() );
+		}else{
+			XPutImage( state.display, state.window, this->gc, buffer.image, rect.x, rect.y, rect.x, rect.y, rect.width, rect.height );
+		}
+	}
+
+	buffer.pending = this->shared;
+	XFlush( state.display );
+
+	// the other buffer is brought up to date once it is used
+	other.stale.swap( this->damaged );
+	this->damaged.clear();
+	this->back ^= 1;
+
+}
+
+/// Change framebuffer size, contents are cleared ///
+void WinxFramebuffer::resize( int width, int height ) {
+	this->destroy();
+	this->width = width;
+	this->height = height;
+	this->create();
+}
+#endif
+
+#if defined(WINX_X11) && defined(WINX_FRAMEBUFFER) && defined(WINX_FRAMEBUFFER_TEST)
+#include <cstdio>
+
+static bool _winx_test_exposed;
+
+static void _WinxTestHandler( const WinxEvent* events, int count, WinxWindow& ) {
+	for( int i = 0; i < count; i ++ ) {
+		if( events[i].type == WINX_EXPOSE ) _winx_test_exposed = true;
+	}
+}
+
+/// Compare window contents with the expected frame ///
+static int _WinxTestCompare( WinxWindowState& state, const uint32_t* expected, int width, int height, int stride ) {
+	XSync( state.display, False );
+	XImage* image = XGetImage( state.display, state.window, 0, 0, width, height, AllPlanes, ZPixmap );
+	if( !image ) return width * height;
+
+	int errors = 0;
+
+	for( int y = 0; y < height; y ++ ) {
+		for( int x = 0; x < width; x ++ ) {
+			if( (XGetPixel( image, x, y ) & 0xFFFFFF) != (expected[y * stride + x] & 0xFFFFFF) ) errors ++;
+		}
+	}
+
+	XDestroyImage( image );
+	return errors;
+}
+
+int main() {
+	const int width = 64, height = 48;
+	int errors = 0;
+
+	try {
+		WinxWindow window( 0, 0, width, height );
+		window.setHandler( _WinxTestHandler );
+
+		for( int i = 0; i < 200 && !_winx_test_exposed; i ++ ) window.waitFor( 10 );
+		if( !_winx_test_exposed ) {
+			fprintf( stderr, "window was never exposed\n" );
+			return 2;
+		}
+
+		WinxFramebuffer framebuffer( window, width, height );
+		std::vector<uint32_t> expected( (size_t) width * height, 0 );
+
+		// the whole frame first, then one small damaged square per frame,
+		// every back buffer must contain all previous frames
+		for( int frame = 0; frame < 32; frame ++ ) {
+			uint32_t* pixels = framebuffer.getPixels();
+			const int stride = framebuffer.getStride();
+			int left = frame ? (frame * 7) % (width - 8) : 0, top = frame ? (frame * 5) % (height - 8) : 0;
+			int right = frame ? left + 8 : width, bottom = frame ? top + 8 : height;
+
+			for( int y = 0; y < height; y ++ ) {
+				for( int x = 0; x < width; x ++ ) {
+					if( pixels[y * stride + x] != expected[y * width + x] ) errors ++;
+				}
+			}
+
+			for( int y = top; y < bottom; y ++ ) {
+				for( int x = left; x < right; x ++ ) {
+					pixels[y * stride + x] = expected[y * width + x] = 0x010203 * (frame + 1) + x * 0x100 + y;
+				}
+			}
+
+			if( frame ) framebuffer.damage( left, top, right - left, bottom - top );
+			framebuffer.present();
+			window.poll();
+		}
+
+		errors += _WinxTestCompare( window.getState(), expected.data(), width, height, width );
+
+		// contents are cleared on resize
+		framebuffer.resize( width / 2, height / 2 );
+		std::vector<uint32_t> cleared( (size_t) width * height / 4, 0 );
+		framebuffer.getPixels();
+		framebuffer.present();
+		errors += _WinxTestCompare( window.getState(), cleared.data(), width / 2, height / 2, width / 2 );
+
+		printf( "shared: %s, errors: %d\n", framebuffer.isShared() ? "yes" : "no", errors );
+	} catch( WinxException& exception ) {
+		fprintf( stderr, "%s\n", exception.what() );
+		return 2;
+	}
+
+	return errors ? 1 : 0;
+}
 #endif
 
 #undef WINX_IMPLEMENT